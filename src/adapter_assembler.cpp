@@ -0,0 +1,110 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "adapter_assembler.h"
+
+
+AdapterAssembler::AdapterAssembler(AssemblerOptions options) :
+    m_options(options),
+    m_kmers(options.kmer),
+    m_cleaned(false)
+{
+    m_kmers.set_threads(options.threads);
+    m_kmers.set_canonical(options.canonical);
+    m_kmers.set_distinct(options.distinct);
+    m_kmers.set_positional(options.positional);
+}
+
+
+// Changes the settings for the next job, which must use the same k-mer size. Returns false if it doesn't.
+bool AdapterAssembler::set_options(AssemblerOptions options) {
+    if (options.kmer != m_options.kmer)
+        return false;
+    m_options = options;
+    m_kmers.set_threads(options.threads);
+    m_kmers.set_canonical(options.canonical);
+    m_kmers.set_distinct(options.distinct);
+    m_kmers.set_positional(options.positional);
+    return true;
+}
+
+
+void AdapterAssembler::add_read(const char * sequence, int length) {
+    if (!m_cleaned)
+        m_kmers.add_read(sequence, length, m_options.start, m_options.end, m_options.margin);
+}
+
+
+void AdapterAssembler::add_reads(const std::vector<std::string> & sequences) {
+    for (auto & sequence : sequences)
+        add_read(sequence.c_str(), int(sequence.size()));
+}
+
+
+bool AdapterAssembler::add_fastq(std::string filename) {
+    if (!m_cleaned)
+        m_kmers.add_fastq(filename, m_options.start, m_options.end, m_options.margin);
+    return !m_cleaned;
+}
+
+
+// Returns the cleaning steps. Calling this again doesn't clean the graph again.
+std::vector<CleaningStep> AdapterAssembler::clean() {
+    if (!m_cleaned) {
+        int filter_depth = int(m_kmers.get_max_depth() * m_options.filter_depth);
+        int tip_length = (m_options.tip_length > 0) ? m_options.tip_length : m_options.kmer;
+        m_cleaning_steps = m_kmers.clean(filter_depth, tip_length);
+        m_cleaned = true;
+    }
+    return m_cleaning_steps;
+}
+
+
+AdapterGraph AdapterAssembler::get_graph() {
+    clean();
+    return m_kmers.get_graph();
+}
+
+
+std::vector<AdapterPath> AdapterAssembler::get_adapters() {
+    clean();
+    return m_kmers.get_adapter_paths();
+}
+
+
+std::vector<AdapterMatch> AdapterAssembler::get_known_adapter_matches() {
+    clean();
+    return match_known_adapters(m_kmers, m_kmers.get_adapter_paths());
+}
+
+
+void AdapterAssembler::write_gfa(std::ostream & out) {
+    clean();
+    m_kmers.output_gfa(out);
+}
+
+
+void AdapterAssembler::write_adapters_fasta(std::ostream & out) {
+    clean();
+    m_kmers.output_adapters_fasta(out);
+}
+
+
+void AdapterAssembler::reset() {
+    m_kmers.clear();
+    m_cleaned = false;
+    m_cleaning_steps.clear();
+}
@@ -0,0 +1,85 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef ADAPTER_ASSEMBLER_H
+#define ADAPTER_ASSEMBLER_H
+
+
+#include <string>
+#include <vector>
+
+#include "kmers.h"
+#include "known_adapters.h"
+
+
+// The same settings as the command line options, with the same defaults.
+struct AssemblerOptions
+{
+    AssemblerOptions() :
+        kmer(10), filter_depth(0.05), margin(250), start(true), end(false), canonical(false), distinct(false),
+        positional(false), tip_length(0), threads(1) {}
+
+    int kmer;
+    double filter_depth;
+    int margin;
+    bool start;
+    bool end;
+    bool canonical;
+    bool distinct;
+    bool positional;
+    int tip_length;
+    int threads;
+};
+
+
+// Adapter discovery for use from other programs (built as libadapterassembler with 'make lib'). Reads are added in
+// memory or from files, and the cleaned graph, adapter sequences and known adapter matches are returned as data
+// rather than printed. Progress messages go to the log callback if one is set (stderr otherwise).
+//
+// The graph is cleaned the first time a result is asked for, and no more reads can be added after that. reset()
+// empties the table for the next set of reads but keeps its cleaning buffers, so one object can be reused for many
+// jobs.
+class AdapterAssembler
+{
+public:
+    AdapterAssembler(AssemblerOptions options);
+
+    bool set_options(AssemblerOptions options);
+    int get_kmer_size() {return m_options.kmer;}
+    void set_log_callback(LogCallback callback) {m_kmers.set_log_callback(callback);}
+
+    void add_read(const char * sequence, int length);
+    void add_reads(const std::vector<std::string> & sequences);
+    bool add_fastq(std::string filename);
+    long long get_read_count() {return m_kmers.get_read_count();}
+
+    std::vector<CleaningStep> clean();
+    AdapterGraph get_graph();
+    std::vector<AdapterPath> get_adapters();
+    std::vector<AdapterMatch> get_known_adapter_matches();
+    void write_gfa(std::ostream & out);
+    void write_adapters_fasta(std::ostream & out);
+
+    void reset();
+
+private:
+    AssemblerOptions m_options;
+    Kmers m_kmers;
+    bool m_cleaned;
+    std::vector<CleaningStep> m_cleaning_steps;
+};
+
+
+#endif // ADAPTER_ASSEMBLER_H
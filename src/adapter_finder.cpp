@@ -0,0 +1,114 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "adapter_finder.h"
+
+#include <algorithm>
+
+
+// A cluster needs at least this many k-mer hits to count as an adapter, so one chance match doesn't trim anything.
+// Hits further apart than CLUSTER_GAP k-mers (enough to span a sequencing error) are in different clusters.
+#define MIN_CLUSTER_HITS 3
+#define CLUSTER_GAP(kmer_size) (2 * (kmer_size))
+
+
+AdapterFinder::AdapterFinder(Kmers & kmers) :
+    m_adapter_kmers(kmers.get_oriented_kmers()),
+    m_kmer_size(kmers.get_kmer_size()),
+    m_start(kmers.get_start()),
+    m_end(kmers.get_end()),
+    m_margin(kmers.get_margin())
+{
+    m_kmer_mask = (m_kmer_size == 16) ? 0xffffffff : (uint32_t(1) << (2 * m_kmer_size)) - 1;
+}
+
+
+// Gives the k-mer position ranges of a read's start window, [0, start_range_end), and end window,
+// [end_range_start, length - k + 1). These are the same windows which are counted.
+void AdapterFinder::get_windows(int length, int & start_range_end, int & end_range_start) const {
+    start_range_end = 0;
+    if (m_start)
+        start_range_end = std::max(std::min(m_margin, length) + 1 - m_kmer_size, 0);
+    end_range_start = std::max(std::max(length - m_margin, 0), start_range_end);
+}
+
+
+// Returns the position just after the first cluster of adapter hits in the start window, or 0 if there isn't one.
+// Clusters with too few hits are skipped, so a chance match ahead of the adapter doesn't hide it.
+int AdapterFinder::find_start_adapter(const std::string & sequence, int range_end) const {
+    int length = int(sequence.size());
+    if (length < m_kmer_size)
+        return 0;
+    uint32_t kmer = 0;
+    int hits = 0, last_hit = -1;
+    int scan_end = std::min(range_end + m_kmer_size - 1, length);
+    for (int i = 0; i < scan_end; ++i) {
+        kmer = ((kmer << 2) | Kmers::base_to_bits(sequence[i])) & m_kmer_mask;
+        int position = i + 1 - m_kmer_size;
+        if (position < 0 || !m_adapter_kmers.contains(kmer))
+            continue;
+        if (last_hit >= 0 && position - last_hit > CLUSTER_GAP(m_kmer_size)) {
+            if (hits >= MIN_CLUSTER_HITS)
+                break;
+            hits = 0;
+        }
+        ++hits;
+        last_hit = position;
+    }
+    return (hits >= MIN_CLUSTER_HITS) ? last_hit + m_kmer_size : 0;
+}
+
+
+// Returns the start of the last cluster of adapter hits in the end window, or the read length if there isn't one.
+int AdapterFinder::find_end_adapter(const std::string & sequence, int range_start) const {
+    int length = int(sequence.size());
+    uint32_t kmer = 0;
+    int hits = 0, cluster_start = length, last_hit = -1;
+    for (int i = range_start; i < length; ++i) {
+        kmer = ((kmer << 2) | Kmers::base_to_bits(sequence[i])) & m_kmer_mask;
+        int position = i + 1 - m_kmer_size;
+        if (position < range_start || !m_adapter_kmers.contains(kmer))
+            continue;
+        if (last_hit < 0 || position - last_hit > CLUSTER_GAP(m_kmer_size)) {
+            hits = 0;
+            cluster_start = position;
+        }
+        ++hits;
+        last_hit = position;
+    }
+    return (hits >= MIN_CLUSTER_HITS) ? cluster_start : length;
+}
+
+
+// Returns true if there is a cluster of adapter hits between the margins at either end of the read, which suggests
+// a chimeric read.
+bool AdapterFinder::find_middle_adapter(const std::string & sequence) const {
+    int range_start = m_margin, range_end = int(sequence.size()) - m_margin;
+    uint32_t kmer = 0;
+    int hits = 0, last_hit = -1;
+    for (int i = range_start; i < range_end; ++i) {
+        kmer = ((kmer << 2) | Kmers::base_to_bits(sequence[i])) & m_kmer_mask;
+        int position = i + 1 - m_kmer_size;
+        if (position < range_start || !m_adapter_kmers.contains(kmer))
+            continue;
+        if (last_hit >= 0 && position - last_hit > CLUSTER_GAP(m_kmer_size))
+            hits = 0;
+        if (++hits >= MIN_CLUSTER_HITS)
+            return true;
+        last_hit = position;
+    }
+    return false;
+}
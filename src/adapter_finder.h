@@ -0,0 +1,53 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef ADAPTER_FINDER_H
+#define ADAPTER_FINDER_H
+
+
+#include <string>
+
+#include "kmers.h"
+#include "kmer_set.h"
+
+
+// Finds adapters in reads using the k-mers of a cleaned graph. Adapter k-mer hits are grouped into clusters (hits
+// further apart than a couple of k-mer lengths are in different clusters), and a cluster with too few hits is taken
+// to be chance matches and ignored.
+class AdapterFinder
+{
+public:
+    AdapterFinder(Kmers & kmers);
+
+    bool get_start() const {return m_start;}
+    bool get_end() const {return m_end;}
+    int get_margin() const {return m_margin;}
+
+    void get_windows(int length, int & start_range_end, int & end_range_start) const;
+    int find_start_adapter(const std::string & sequence, int range_end) const;
+    int find_end_adapter(const std::string & sequence, int range_start) const;
+    bool find_middle_adapter(const std::string & sequence) const;
+
+private:
+    KmerSet m_adapter_kmers;
+    int m_kmer_size;
+    uint32_t m_kmer_mask;
+    bool m_start;
+    bool m_end;
+    int m_margin;
+};
+
+
+#endif // ADAPTER_FINDER_H
@@ -20,6 +20,9 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
 
 #include "args.h"
 
@@ -41,16 +44,58 @@ struct DoublesReader
 };
 
 
+// Reads a comma-separated list of non-negative numbers.
+struct DoubleListReader
+{
+    void operator()(const std::string &name, const std::string &value, std::vector<double> &destination) {
+        DoublesReader reader;
+        destination.clear();
+        std::istringstream list(value);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            double number;
+            reader(name, item, number);
+            destination.push_back(number);
+        }
+    }
+};
+
+
 typedef args::ValueFlag<double, DoublesReader> d_arg;
 typedef args::ValueFlag<int> i_arg;
+typedef args::ValueFlag<long long> l_arg;
 typedef args::Flag f_arg;
 
 
 Arguments::Arguments(int argc, char **argv) {
 
-    args::ArgumentParser parser("Adapter-assembler: a tool for extracting adapter sequences from long reads",
+    // Subcommands come first and are stripped off before parsing, so they share the same options.
+    command = ASSEMBLE;
+    if (argc > 1 && std::string(argv[1]) == "load")
+        command = LOAD;
+    else if (argc > 1 && std::string(argv[1]) == "merge")
+        command = MERGE;
+    else if (argc > 1 && std::string(argv[1]) == "trim")
+        command = TRIM;
+    else if (argc > 1 && std::string(argv[1]) == "scan")
+        command = SCAN;
+    else if (argc > 1 && std::string(argv[1]) == "serve")
+        command = SERVE;
+    if (command != ASSEMBLE) {
+        --argc;
+        ++argv;
+    }
+
+    args::ArgumentParser parser("Adapter-assembler: a tool for extracting adapter sequences from long reads. "
+                                "Use 'adapter_assembler load' to clean saved k-mer count files instead of reads, "
+                                "'adapter_assembler merge' to combine k-mer count files, 'adapter_assembler trim' to "
+                                "remove the adapters found from the reads (trimmed reads go to stdout), "
+                                "'adapter_assembler scan' to report how many reads have the adapters (as JSON), or "
+                                "'adapter_assembler serve' to run jobs read from stdin (options set job defaults).",
                                 "For more information, go to: https://github.com/rrwick/Adapter-assembler");
     parser.LongSeparator(" ");
+    if (command != ASSEMBLE)
+        parser.Prog(std::string("adapter_assembler ") + argv[0]);
 
     struct winsize w;
     ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
@@ -90,8 +135,101 @@ Arguments::Arguments(int argc, char **argv) {
                    "assemble bases from end of reads",
                    {"end"});
 
+    f_arg canonical_arg(parser, "canonical",
+                        "count each k-mer together with its reverse complement, making a bi-directed graph (allows "
+                        "--start and --end together)",
+                        {"canonical"});
+    f_arg distinct_arg(parser, "distinct",
+                       "count each k-mer at most once per read, so repeats within a read don't inflate depths",
+                       {"distinct"});
+    f_arg positional_arg(parser, "positional",
+                         "track where in the margin each k-mer occurs and remove k-mers with scattered positions",
+                         {"positional"});
+    i_arg tip_length_arg(parser, "int",
+                         "tips up to this many k-mers long can be pruned (default: same as --kmer)",
+                         {"tip_length"}, 0);
+
+    l_arg max_reads_arg(parser, "int",
+                        "stop hashing after this many reads (default: 0 = no limit)",
+                        {"max_reads"}, 0);
+    d_arg sample_fraction_arg(parser, "float",
+                              "hash only this fraction of reads, chosen deterministically by read name (default: 1.0)",
+                              {"sample_fraction"}, 1.0);
+    f_arg converge_arg(parser, "converge",
+                       "stop hashing once the filtered k-mers stop changing between batches of 10,000 reads",
+                       {"converge"});
+    d_arg converge_tolerance_arg(parser, "float",
+                                 "largest relative change between batches which counts as converged (default: 0.02)",
+                                 {"converge_tolerance"}, 0.02);
+
+    i_arg max_memory_arg(parser, "MB",
+                         "count k-mers on disk to use no more than about this much memory (default: 0 = count in memory)",
+                         {"max_memory"}, 0);
+    args::ValueFlag<std::string> temp_dir_arg(parser, "dir",
+                                              "directory for temporary files when using --max_memory (default: .)",
+                                              {"temp_dir"}, ".");
+
+    args::ValueFlag<std::string> save_counts_arg(parser, "file",
+                                                 "save the raw k-mer counts to this file (required for merge)",
+                                                 {"save_counts"});
+
+    args::ValueFlag<std::string> counts_arg(parser, "file",
+                                            "for trim and scan: take the adapter k-mers from this count file "
+                                            "instead of counting the reads",
+                                            {"counts"});
+
+    args::ValueFlag<std::string> adapters_out_arg(parser, "file",
+                   "save adapter sequences taken from the deepest paths through the cleaned graph to this FASTA file",
+                   {"adapters_out"});
+    f_arg no_known_adapters_arg(parser, "no_known_adapters",
+                                "don't compare the cleaned graph to the built-in list of known adapters",
+                                {"no_known_adapters"});
+    i_arg shards_arg(parser, "int",
+                     "split the saved k-mer counts into this many shard files, PREFIX.0 to PREFIX.N-1 (default: 1)",
+                     {"shards"}, 1);
+    args::ValueFlag<std::vector<double>, DoubleListReader> sweep_arg(parser, "floats",
+                   "comma-separated list of filter depths to try: makes one graph for each instead of using --filter_depth",
+                   {"sweep"});
+    args::ValueFlag<std::string> sweep_prefix_arg(parser, "prefix",
+                   "graphs from --sweep are saved to PREFIX_DEPTH.gfa (default: sweep)",
+                   {"sweep_prefix"}, "sweep");
+
+    args::ValueFlag<std::string> manifest_arg(parser, "file",
+                   "assemble each sample in this file separately: one sample per line, a name followed by its read "
+                   "files",
+                   {"manifest"});
+    args::ValueFlag<std::string> batch_dir_arg(parser, "dir",
+                   "graphs from --manifest are saved to DIR/SAMPLE.gfa (default: .)",
+                   {"batch_dir"}, ".");
+
+    args::ValueFlag<std::string> barcodes_arg(parser, "file",
+                   "FASTA file of seed barcodes: reads are sorted by barcode and each barcode gets its own graph",
+                   {"barcodes"});
+    args::ValueFlag<std::string> barcode_prefix_arg(parser, "prefix",
+                   "graphs from --barcodes are saved to PREFIX_BARCODE.gfa (default: barcode)",
+                   {"barcode_prefix"}, "barcode");
+
+    args::ValueFlag<std::string> watch_arg(parser, "dir",
+                   "keep watching this directory and add each new read file to the graph as it appears",
+                   {"watch"});
+    args::ValueFlag<std::string> watch_prefix_arg(parser, "prefix",
+                   "the graph from --watch is saved to PREFIX.gfa after each update (default: live)",
+                   {"watch_prefix"}, "live");
+    i_arg watch_interval_arg(parser, "seconds",
+                             "how often --watch checks for new files (default: 30)",
+                             {"watch_interval"}, 30);
+    i_arg watch_idle_arg(parser, "seconds",
+                         "stop watching after this long without new files (default: 0 = never stop)",
+                         {"watch_idle"}, 0);
+
+    int default_threads = std::max(int(std::thread::hardware_concurrency()), 1);
+    i_arg threads_arg(parser, "int",
+                      "number of CPU threads (default: " + std::to_string(default_threads) + ")",
+                      {'t', "threads"}, default_threads);
+
     args::PositionalList<std::string> input_reads_arg(parser, "input_reads",
-                                                      "input long reads for adapter assembly");
+                                                      "input long reads for adapter assembly (k-mer count files "
+                                                      "for load and merge)");
 
     f_arg version_arg(parser, "version",
                       "display the program version and quit",
@@ -121,7 +259,7 @@ Arguments::Arguments(int argc, char **argv) {
         parsing_result = BAD;
         return;
     }
-    if (argc == 1) {
+    if (argc == 1 && command != SERVE) {
         std::cerr << parser;
         parsing_result = HELP;
         return;
@@ -134,8 +272,29 @@ Arguments::Arguments(int argc, char **argv) {
     for (const auto read_file : args::get(input_reads_arg))
         input_reads.push_back(read_file);
 
-    if (input_reads.empty()) {
-        std::cerr << "Error: input reads are required" << "\n";
+    if (manifest_arg) {
+        if (command != ASSEMBLE || !input_reads.empty()) {
+            std::cerr << "Error: --manifest cannot be used with input reads, load or merge\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (!read_manifest(args::get(manifest_arg))) {
+            parsing_result = BAD;
+            return;
+        }
+    }
+    else if (command == SERVE) {
+        if (!input_reads.empty()) {
+            std::cerr << "Error: serve takes its read files from the jobs on stdin\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
+    else if (input_reads.empty() && !(watch_arg && command == ASSEMBLE)) {  // reads are optional when watching
+        if (command == ASSEMBLE || command == TRIM || command == SCAN)
+            std::cerr << "Error: input reads are required" << "\n";
+        else
+            std::cerr << "Error: input k-mer count files are required" << "\n";
         parsing_result = BAD;
         return;
     }
@@ -147,11 +306,52 @@ Arguments::Arguments(int argc, char **argv) {
         }
     }
 
+    if (command == LOAD || command == MERGE)
+        input_counts.swap(input_reads);
+
+    if (counts_arg) {
+        if (command != TRIM && command != SCAN) {
+            std::cerr << "Error: --counts can only be used with trim and scan\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (!does_file_exist(args::get(counts_arg))) {
+            std::cerr << "Error: cannot find file: " << args::get(counts_arg) << "\n";
+            parsing_result = BAD;
+            return;
+        }
+        input_counts.push_back(args::get(counts_arg));
+    }
+
     kmer = args::get(kmer_arg);
     filter_depth = args::get(filter_depth_arg);
     margin = args::get(margin_arg);
     start = args::get(start_arg);
     end = args::get(end_arg);
+    canonical = args::get(canonical_arg);
+    distinct = args::get(distinct_arg);
+    no_known_adapters = args::get(no_known_adapters_arg);
+    positional = args::get(positional_arg);
+    tip_length = args::get(tip_length_arg);
+    max_reads = args::get(max_reads_arg);
+    sample_fraction = args::get(sample_fraction_arg);
+    converge = args::get(converge_arg);
+    converge_tolerance = args::get(converge_tolerance_arg);
+    max_memory = args::get(max_memory_arg);
+    temp_dir = args::get(temp_dir_arg);
+    save_counts = args::get(save_counts_arg);
+    adapters_out = args::get(adapters_out_arg);
+    shards = args::get(shards_arg);
+    batch_dir = args::get(batch_dir_arg);
+    barcodes = args::get(barcodes_arg);
+    barcode_prefix = args::get(barcode_prefix_arg);
+    watch_dir = args::get(watch_arg);
+    watch_prefix = args::get(watch_prefix_arg);
+    watch_interval = args::get(watch_interval_arg);
+    watch_idle = args::get(watch_idle_arg);
+    sweep = args::get(sweep_arg);
+    sweep_prefix = args::get(sweep_prefix_arg);
+    threads = args::get(threads_arg);
 
     if (kmer < 4 || kmer > 16) {
         std::cerr << "Error: --kmer must be between 4 and 16 (inclusive)\n";
@@ -171,8 +371,157 @@ Arguments::Arguments(int argc, char **argv) {
         return;
     }
 
-    if (start == end) {
-        std::cerr << "Error: either --start or --end must be used (but not both)\n";
+    if (tip_length < 0) {
+        std::cerr << "Error: --tip_length cannot be negative\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (max_reads < 0) {
+        std::cerr << "Error: --max_reads cannot be negative\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (sample_fraction <= 0.0 || sample_fraction > 1.0) {
+        std::cerr << "Error: --sample_fraction must be greater than 0 and no more than 1\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (converge_tolerance < 0.0 || converge_tolerance > 1.0) {
+        std::cerr << "Error: --converge_tolerance must be between 0 and 1 (inclusive)\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    for (auto fraction : sweep) {
+        if (fraction > 1.0) {
+            std::cerr << "Error: --sweep depths must be between 0 and 1 (inclusive)\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
+
+    if (max_memory < 0) {
+        std::cerr << "Error: --max_memory cannot be negative\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Disk-based counting only keeps k-mers which could pass the depth filter, so it can't be combined with options
+    // that need the whole table.
+    if (max_memory > 0 && (converge || !save_counts.empty())) {
+        std::cerr << "Error: --max_memory cannot be used with --converge or --save_counts\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Positions are only kept in memory, and not in count files.
+    if (positional && (max_memory > 0 || !save_counts.empty() || !input_counts.empty())) {
+        std::cerr << "Error: --positional cannot be used with --max_memory, --save_counts, --counts, load or merge\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (shards < 1) {
+        std::cerr << "Error: --shards must be at least 1\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (shards > 1 && save_counts.empty()) {
+        std::cerr << "Error: --shards requires --save_counts\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (threads < 1) {
+        std::cerr << "Error: --threads must be at least 1\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Each sample is counted and cleaned on its own, so only the options which apply to a single in-memory run work.
+    if (!samples.empty() && (max_memory > 0 || !save_counts.empty() || !adapters_out.empty() || !sweep.empty())) {
+        std::cerr << "Error: --manifest cannot be used with --max_memory, --save_counts, --adapters_out or --sweep\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (!barcodes.empty()) {
+        if (command != ASSEMBLE || !samples.empty()) {
+            std::cerr << "Error: --barcodes cannot be used with --manifest, load or merge\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (max_memory > 0 || converge || !save_counts.empty() || !adapters_out.empty() || !sweep.empty()) {
+            std::cerr << "Error: --barcodes cannot be used with --max_memory, --converge, --save_counts, "
+                         "--adapters_out or --sweep\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (!does_file_exist(barcodes)) {
+            std::cerr << "Error: cannot find file: " << barcodes << "\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
+
+    if ((command == TRIM || command == SCAN) && !sweep.empty()) {
+        std::cerr << "Error: --sweep cannot be used with trim or scan\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // --adapters_out names one file, but --sweep makes a graph for each depth.
+    if (!adapters_out.empty() && !sweep.empty()) {
+        std::cerr << "Error: --adapters_out cannot be used with --sweep\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (command == SERVE && (max_memory > 0 || !save_counts.empty() || !adapters_out.empty() || !sweep.empty() ||
+                             !barcodes.empty() || positional || converge || max_reads > 0 || sample_fraction < 1.0)) {
+        std::cerr << "Error: serve only takes the --kmer, --filter_depth, --margin, --start, --end, --canonical, "
+                     "--distinct, --tip_length and --threads options\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (!watch_dir.empty()) {
+        if (command != ASSEMBLE || !samples.empty() || !barcodes.empty() || !sweep.empty()) {
+            std::cerr << "Error: --watch cannot be used with --manifest, --barcodes, --sweep or subcommands\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (max_memory > 0 || converge || max_reads > 0 || !save_counts.empty()) {
+            std::cerr << "Error: --watch cannot be used with --max_memory, --converge, --max_reads or --save_counts\n";
+            parsing_result = BAD;
+            return;
+        }
+        if (watch_interval < 1 || watch_idle < 0) {
+            std::cerr << "Error: --watch_interval must be at least 1 and --watch_idle cannot be negative\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
+
+    if (command == MERGE && save_counts.empty()) {
+        std::cerr << "Error: merge requires --save_counts\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // When loading count files, the read start/end mode comes from them.
+    if (input_counts.empty() && !start && !end && command != SERVE) {
+        std::cerr << "Error: either --start or --end must be used\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (input_counts.empty() && start && end && !canonical) {
+        std::cerr << "Error: --start and --end can only be used together with --canonical\n";
         parsing_result = BAD;
         return;
     }
@@ -182,4 +531,54 @@ Arguments::Arguments(int argc, char **argv) {
 bool Arguments::does_file_exist(std::string filename){
     std::ifstream infile(filename);
     return infile.good();
-}
\ No newline at end of file
+}
+
+
+// Manifest lines are a sample name followed by one or more read files, separated by whitespace. Blank lines and lines
+// starting with '#' are ignored.
+bool Arguments::read_manifest(std::string filename) {
+    std::ifstream manifest(filename);
+    if (!manifest) {
+        std::cerr << "Error: cannot find file: " << filename << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        Sample sample;
+        if (!(fields >> sample.name) || sample.name[0] == '#')
+            continue;
+        std::string read_file;
+        while (fields >> read_file)
+            sample.read_files.push_back(read_file);
+        if (sample.read_files.empty()) {
+            std::cerr << "Error: sample " << sample.name << " in " << filename << " has no read files\n";
+            return false;
+        }
+        // The name becomes a file name in --batch_dir, so it can't be allowed to lead anywhere else.
+        if (sample.name.find('/') != std::string::npos || sample.name.find('\\') != std::string::npos ||
+                sample.name.find("..") != std::string::npos) {
+            std::cerr << "Error: sample name " << sample.name << " in " << filename
+                      << " cannot contain '/', '\\' or '..'\n";
+            return false;
+        }
+        for (auto existing : samples) {
+            if (existing.name == sample.name) {
+                std::cerr << "Error: sample " << sample.name << " appears more than once in " << filename << "\n";
+                return false;
+            }
+        }
+        for (auto file : sample.read_files) {
+            if (!does_file_exist(file)) {
+                std::cerr << "Error: cannot find file: " << file << "\n";
+                return false;
+            }
+        }
+        samples.push_back(sample);
+    }
+    if (samples.empty()) {
+        std::cerr << "Error: " << filename << " contains no samples\n";
+        return false;
+    }
+    return true;
+}
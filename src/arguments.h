@@ -23,6 +23,16 @@
 
 enum ParsingResult {GOOD, BAD, HELP, VERSION};
 
+enum Command {ASSEMBLE, LOAD, MERGE, TRIM, SCAN, SERVE};
+
+
+// One line of a --manifest file: a sample name and the read files which belong to it.
+struct Sample
+{
+    std::string name;
+    std::vector<std::string> read_files;
+};
+
 
 class Arguments
 {
@@ -30,18 +40,53 @@ public:
     Arguments(int argc, char **argv);
 
     ParsingResult parsing_result;
+    Command command;
 
     std::vector<std::string> input_reads;
+    std::vector<std::string> input_counts;
+    std::string save_counts;
+    std::string adapters_out;
+    int shards;
+
+    std::vector<Sample> samples;
+    std::string batch_dir;
+
+    std::string barcodes;
+    std::string barcode_prefix;
+
+    std::string watch_dir;
+    std::string watch_prefix;
+    int watch_interval;
+    int watch_idle;
+
+    std::vector<double> sweep;
+    std::string sweep_prefix;
+
+    int threads;
 
     int kmer;
     double filter_depth;
     int margin;
     bool start;
     bool end;
+    int tip_length;
+    bool positional;
+    bool distinct;
+    bool canonical;
+    bool no_known_adapters;
+
+    long long max_reads;
+    double sample_fraction;
+    bool converge;
+    double converge_tolerance;
+
+    int max_memory;
+    std::string temp_dir;
 
 
 private:
     bool does_file_exist(std::string fileName);
+    bool read_manifest(std::string filename);
 };
 
 #endif // ARGUMENTS_H
@@ -0,0 +1,129 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "barcodes.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+
+BarcodeClassifier::BarcodeClassifier(int kmer_size) :
+    m_encoder(kmer_size)
+{
+}
+
+
+// Reads the barcodes from a FASTA file. The name is the first word of each header line.
+bool BarcodeClassifier::load(std::string filename) {
+    std::ifstream fasta(filename);
+    if (!fasta) {
+        std::cerr << "Error: cannot open " << filename << "\n";
+        return false;
+    }
+    std::string line, name, sequence;
+    while (std::getline(fasta, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty() && line[0] == '>') {
+            if (!name.empty())
+                add_barcode(name, sequence);
+            name = line.substr(1, line.find_first_of(" \t") - 1);
+            sequence.clear();
+        }
+        else
+            sequence += line;
+    }
+    if (!name.empty())
+        add_barcode(name, sequence);
+
+    if (m_names.empty()) {
+        std::cerr << "Error: " << filename << " contains no barcodes\n";
+        return false;
+    }
+    for (size_t i = 0; i < m_names.size(); ++i) {
+        if (m_min_hits[i] == 0) {
+            std::cerr << "Error: barcode " << m_names[i] << " is shorter than the k-mer size\n";
+            return false;
+        }
+        if (std::count(m_names.begin(), m_names.end(), m_names[i]) > 1) {
+            std::cerr << "Error: barcode " << m_names[i] << " appears more than once in " << filename << "\n";
+            return false;
+        }
+    }
+    m_hits.assign(m_names.size(), 0);
+    return true;
+}
+
+
+// Both orientations of the barcode are indexed, so it is found whichever way round the read is.
+void BarcodeClassifier::add_barcode(std::string name, std::string sequence) {
+    int barcode = int(m_names.size());
+    m_names.push_back(name);
+    int kmer_size = m_encoder.get_kmer_size();
+    int kmer_count = std::max(int(sequence.size()) - kmer_size + 1, 0);
+    m_min_hits.push_back((kmer_count + 3) / 4);
+    for (int i = 0; i < kmer_count; ++i) {
+        uint32_t kmer = m_encoder.kmer_to_bits(&sequence[i]);
+        for (auto oriented : {kmer, m_encoder.reverse_complement(kmer)}) {
+            std::vector<int> & barcodes = m_kmer_barcodes[oriented];
+            if (std::find(barcodes.begin(), barcodes.end(), barcode) == barcodes.end())
+                barcodes.push_back(barcode);
+        }
+    }
+}
+
+
+// Returns the index of the read's barcode, or -1 if it is unclassified. The windows are the same ones which are
+// counted.
+int BarcodeClassifier::classify(const char * sequence, int length, bool start, bool end, int margin) {
+    int kmer_size = m_encoder.get_kmer_size();
+    std::fill(m_hits.begin(), m_hits.end(), 0);
+    int start_range_end = 0;
+    if (start) {
+        start_range_end = std::max(std::min(margin, length) + 1 - kmer_size, 0);
+        count_hits(sequence, 0, start_range_end);
+    }
+    if (end) {
+        int range_start = std::max(std::max(length - margin, 0), start_range_end);
+        count_hits(sequence, range_start, length + 1 - kmer_size);
+    }
+
+    int best = -1;
+    bool tied = false;
+    for (int i = 0; i < int(m_hits.size()); ++i) {
+        if (m_hits[i] < m_min_hits[i])
+            continue;
+        if (best == -1 || m_hits[i] > m_hits[best]) {
+            best = i;
+            tied = false;
+        }
+        else if (m_hits[i] == m_hits[best])
+            tied = true;
+    }
+    return tied ? -1 : best;
+}
+
+
+void BarcodeClassifier::count_hits(const char * sequence, int range_start, int range_end) {
+    for (int i = range_start; i < range_end; ++i) {
+        auto found = m_kmer_barcodes.find(m_encoder.kmer_to_bits(sequence + i));
+        if (found == m_kmer_barcodes.end())
+            continue;
+        for (auto barcode : found->second)
+            ++m_hits[barcode];
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef BARCODES_H
+#define BARCODES_H
+
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "kmers.h"
+
+
+// Seed barcodes, used to decide which barcode each read carries. A read's window is assigned to the barcode (in
+// either orientation) which shares the most k-mers with it, as long as at least a quarter of that barcode's k-mers are
+// present and no other barcode does equally well. Otherwise the read is unclassified.
+class BarcodeClassifier
+{
+public:
+    BarcodeClassifier(int kmer_size);
+
+    bool load(std::string filename);
+    int get_barcode_count() const {return int(m_names.size());}
+    std::string get_name(int barcode) const {return m_names[barcode];}
+
+    int classify(const char * sequence, int length, bool start, bool end, int margin);
+
+private:
+    Kmers m_encoder;
+    std::vector<std::string> m_names;
+    std::vector<int> m_min_hits;
+    std::unordered_map<uint32_t, std::vector<int>> m_kmer_barcodes;
+    std::vector<int> m_hits;
+
+    void add_barcode(std::string name, std::string sequence);
+    void count_hits(const char * sequence, int range_start, int range_end);
+};
+
+
+#endif // BARCODES_H
@@ -0,0 +1,191 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "count_file.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+
+template <typename T>
+static void write_value(std::ofstream & out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+
+template <typename T>
+static bool read_value(std::ifstream & in, T & value) {
+    return bool(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+
+// The k-mer is mixed (with the MurmurHash3 finaliser) before taking the modulus, so shards get similar numbers of
+// k-mers even though low-complexity k-mers are more common.
+uint32_t get_kmer_shard(uint32_t kmer, uint32_t shard_count) {
+    kmer ^= kmer >> 16;
+    kmer *= 0x85ebca6b;
+    kmer ^= kmer >> 13;
+    kmer *= 0xc2b2ae35;
+    kmer ^= kmer >> 16;
+    return kmer % shard_count;
+}
+
+
+// The read ends counted are stored as bit flags: 1 for read starts, 2 for read ends and 4 for canonical k-mers.
+// Files before version 3 only stored 1 for starts and 0 for ends.
+static uint32_t get_mode_bits(const CountFileHeader & header) {
+    return (header.start ? 1 : 0) | (header.end ? 2 : 0) | (header.canonical ? 4 : 0);
+}
+
+
+static void set_mode_bits(CountFileHeader & header, uint32_t version, uint32_t mode) {
+    if (version < 3)
+        mode = (mode != 0) ? 1 : 2;
+    header.start = (mode & 1) != 0;
+    header.end = (mode & 2) != 0;
+    header.canonical = (mode & 4) != 0;
+}
+
+
+bool write_count_file(std::string filename, CountFileHeader header,
+                      const std::vector<std::pair<uint32_t, uint32_t>> & sorted_counts) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: cannot write to " << filename << "\n";
+        return false;
+    }
+
+    // Dense storage costs 4 bytes for every possible k-mer, sparse storage costs 8 bytes for every present k-mer.
+    uint64_t possible_kmers = uint64_t(1) << (2 * header.kmer_size);
+    header.entry_count = sorted_counts.size();
+    header.layout = (header.entry_count * 2 > possible_kmers) ? DENSE : SPARSE;
+
+    out.write(COUNT_FILE_MAGIC, 8);
+    write_value<uint32_t>(out, COUNT_FILE_VERSION);
+    write_value<uint32_t>(out, header.kmer_size);
+    write_value<uint32_t>(out, get_mode_bits(header));
+    write_value<uint32_t>(out, header.margin);
+    write_value<uint64_t>(out, header.read_count);
+    write_value<uint32_t>(out, header.max_depth);
+    write_value<uint32_t>(out, header.layout);
+    write_value<uint64_t>(out, header.entry_count);
+    write_value<uint32_t>(out, header.shard_index);
+    write_value<uint32_t>(out, header.shard_count);
+
+    std::vector<uint32_t> buffer;
+    buffer.reserve(1 << 16);
+    if (header.layout == DENSE) {
+        auto next = sorted_counts.begin();
+        for (uint64_t kmer = 0; kmer < possible_kmers; ++kmer) {
+            if (next != sorted_counts.end() && next->first == kmer) {
+                buffer.push_back(next->second);
+                ++next;
+            }
+            else
+                buffer.push_back(0);
+            if (buffer.size() == buffer.capacity()) {
+                out.write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.size() * sizeof(uint32_t)));
+                buffer.clear();
+            }
+        }
+    }
+    else {  // SPARSE
+        for (auto kv : sorted_counts) {
+            buffer.push_back(kv.first);
+            buffer.push_back(kv.second);
+            if (buffer.size() == buffer.capacity()) {
+                out.write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.size() * sizeof(uint32_t)));
+                buffer.clear();
+            }
+        }
+    }
+    out.write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.size() * sizeof(uint32_t)));
+
+    if (!out) {
+        std::cerr << "Error: failed writing " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+
+bool read_count_file_header(std::ifstream & in, std::string filename, CountFileHeader & header) {
+    char magic[8];
+    uint32_t version, mode;
+    if (!in.read(magic, 8) || std::memcmp(magic, COUNT_FILE_MAGIC, 8) != 0) {
+        std::cerr << "Error: " << filename << " is not a k-mer count file\n";
+        return false;
+    }
+    if (!read_value(in, version) || version < 1 || version > COUNT_FILE_VERSION) {
+        std::cerr << "Error: " << filename << " has an unsupported count file version\n";
+        return false;
+    }
+    if (!read_value(in, header.kmer_size) || !read_value(in, mode) || !read_value(in, header.margin) ||
+        !read_value(in, header.read_count) || !read_value(in, header.max_depth) || !read_value(in, header.layout) ||
+        !read_value(in, header.entry_count)) {
+        std::cerr << "Error: " << filename << " is truncated\n";
+        return false;
+    }
+    header.shard_index = 0;
+    header.shard_count = 1;
+    if (version >= 2 && (!read_value(in, header.shard_index) || !read_value(in, header.shard_count))) {
+        std::cerr << "Error: " << filename << " is truncated\n";
+        return false;
+    }
+    set_mode_bits(header, version, mode);
+    if (header.kmer_size < 1 || header.kmer_size > 16 || header.layout > DENSE ||
+        header.shard_count < 1 || header.shard_index >= header.shard_count) {
+        std::cerr << "Error: " << filename << " has an invalid header\n";
+        return false;
+    }
+    return true;
+}
+
+
+bool read_count_file_entries(std::ifstream & in, std::string filename, const CountFileHeader & header,
+                             std::function<void(uint32_t, uint32_t)> add) {
+    std::vector<uint32_t> buffer(1 << 16);
+    if (header.layout == DENSE) {
+        uint64_t possible_kmers = uint64_t(1) << (2 * header.kmer_size);
+        uint64_t kmer = 0;
+        while (kmer < possible_kmers) {
+            uint64_t chunk = std::min(uint64_t(buffer.size()), possible_kmers - kmer);
+            if (!in.read(reinterpret_cast<char *>(buffer.data()), std::streamsize(chunk * sizeof(uint32_t))))
+                break;
+            for (uint64_t i = 0; i < chunk; ++i, ++kmer) {
+                if (buffer[i] > 0)
+                    add(uint32_t(kmer), buffer[i]);
+            }
+        }
+        if (kmer == possible_kmers)
+            return true;
+    }
+    else {  // SPARSE
+        uint64_t entry = 0;
+        while (entry < header.entry_count) {
+            uint64_t chunk = std::min(uint64_t(buffer.size() / 2), header.entry_count - entry);
+            if (!in.read(reinterpret_cast<char *>(buffer.data()), std::streamsize(chunk * 2 * sizeof(uint32_t))))
+                break;
+            for (uint64_t i = 0; i < chunk; ++i, ++entry)
+                add(buffer[2 * i], buffer[2 * i + 1]);
+        }
+        if (entry == header.entry_count)
+            return true;
+    }
+    std::cerr << "Error: " << filename << " is truncated\n";
+    return false;
+}
@@ -0,0 +1,69 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef COUNT_FILE_H
+#define COUNT_FILE_H
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+
+
+// A k-mer count file holds a raw (uncleaned) k-mer table so it can be cleaned again later or merged with counts from
+// other runs. It is a fixed-size header followed by the counts, stored either sparse (sorted k-mer/count pairs) or
+// dense (one count for every possible k-mer), whichever is smaller. Values are written in native byte order.
+//
+// A count file can also be one shard of a partitioned table: it then only holds the k-mers which hash to its shard
+// index, so shards with different indices never share k-mers and can be combined without summing.
+
+#define COUNT_FILE_MAGIC "AACOUNTS"
+#define COUNT_FILE_VERSION 3
+
+enum CountFileLayout {SPARSE = 0, DENSE = 1};
+
+
+struct CountFileHeader
+{
+    uint32_t kmer_size;
+    bool start;
+    bool end;
+    bool canonical;
+    uint32_t margin;
+    uint64_t read_count;
+    uint32_t max_depth;
+    uint32_t layout;
+    uint64_t entry_count;
+    uint32_t shard_index;
+    uint32_t shard_count;
+};
+
+
+uint32_t get_kmer_shard(uint32_t kmer, uint32_t shard_count);
+
+
+bool write_count_file(std::string filename, CountFileHeader header,
+                      const std::vector<std::pair<uint32_t, uint32_t>> & sorted_counts);
+
+bool read_count_file_header(std::ifstream & in, std::string filename, CountFileHeader & header);
+
+// Reads all entries after the header, calling add(kmer, count) for each k-mer with a non-zero count.
+bool read_count_file_entries(std::ifstream & in, std::string filename, const CountFileHeader & header,
+                             std::function<void(uint32_t, uint32_t)> add);
+
+
+#endif // COUNT_FILE_H
@@ -0,0 +1,104 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "disk_partitions.h"
+
+#include <iostream>
+#include <unistd.h>
+
+#include "count_file.h"
+
+
+DiskPartitions::DiskPartitions(std::string temp_dir, int partition_count, size_t buffer_kmers) {
+    m_buffer_kmers = buffer_kmers;
+    m_kmer_count = 0;
+    m_good = true;
+
+    std::string prefix = temp_dir + "/adapter_assembler_" + std::to_string(getpid()) + "_";
+    for (int i = 0; i < partition_count; ++i) {
+        std::string filename = prefix + std::to_string(i) + ".tmp";
+        FILE * file = fopen(filename.c_str(), "w+b");
+        if (file == NULL) {
+            std::cerr << "Error: cannot create temporary file " << filename << "\n";
+            m_good = false;
+            return;
+        }
+        m_filenames.push_back(filename);
+        m_files.push_back(file);
+        m_buffers.push_back(std::vector<uint32_t>());
+        m_buffers.back().reserve(m_buffer_kmers);
+    }
+}
+
+
+DiskPartitions::~DiskPartitions() {
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        if (m_files[i] != NULL) {
+            fclose(m_files[i]);
+            remove(m_filenames[i].c_str());
+        }
+    }
+}
+
+
+void DiskPartitions::add_kmer(uint32_t kmer) {
+    int partition = int(get_kmer_shard(kmer, uint32_t(m_files.size())));
+    m_buffers[partition].push_back(kmer);
+    ++m_kmer_count;
+    if (m_buffers[partition].size() >= m_buffer_kmers)
+        flush(partition);
+}
+
+
+void DiskPartitions::flush(int partition) {
+    std::vector<uint32_t> & buffer = m_buffers[partition];
+    if (buffer.empty())
+        return;
+    if (fwrite(buffer.data(), sizeof(uint32_t), buffer.size(), m_files[partition]) != buffer.size()) {
+        if (m_good)
+            std::cerr << "\nError: failed writing temporary file " << m_filenames[partition] << "\n";
+        m_good = false;
+    }
+    buffer.clear();
+}
+
+
+// Adds every k-mer in the partition to counts. This can only be done once per partition (its file is deleted
+// afterwards), after all k-mers have been added.
+bool DiskPartitions::count_partition(int partition, std::unordered_map<uint32_t, int> & counts) {
+    flush(partition);
+    if (!m_good || m_files[partition] == NULL)
+        return false;
+
+    FILE * file = m_files[partition];
+    rewind(file);
+    std::vector<uint32_t> buffer(m_buffer_kmers);
+    size_t read;
+    while ((read = fread(buffer.data(), sizeof(uint32_t), buffer.size(), file)) > 0) {
+        for (size_t i = 0; i < read; ++i)
+            ++counts[buffer[i]];
+    }
+    if (ferror(file)) {
+        std::cerr << "Error: failed reading temporary file " << m_filenames[partition] << "\n";
+        return false;
+    }
+
+    // The partition's k-mers aren't needed again, so its disk space can be freed now.
+    fclose(file);
+    remove(m_filenames[partition].c_str());
+    m_files[partition] = NULL;
+    return true;
+}
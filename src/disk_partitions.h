@@ -0,0 +1,55 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef DISK_PARTITIONS_H
+#define DISK_PARTITIONS_H
+
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <unordered_map>
+
+
+// Temporary files which k-mers are spilled to when counting with a memory limit. Each k-mer goes to the partition
+// given by get_kmer_shard, so every occurrence of a k-mer ends up in the same partition and each partition can be
+// counted on its own. The files are deleted when this object is destroyed.
+class DiskPartitions
+{
+public:
+    DiskPartitions(std::string temp_dir, int partition_count, size_t buffer_kmers);
+    ~DiskPartitions();
+
+    bool is_good() {return m_good;}
+    int get_partition_count() {return int(m_files.size());}
+    long long get_kmer_count() {return m_kmer_count;}
+
+    void add_kmer(uint32_t kmer);
+    bool count_partition(int partition, std::unordered_map<uint32_t, int> & counts);
+
+private:
+    std::vector<std::string> m_filenames;
+    std::vector<FILE *> m_files;
+    std::vector<std::vector<uint32_t>> m_buffers;
+    size_t m_buffer_kmers;
+    long long m_kmer_count;
+    bool m_good;
+
+    void flush(int partition);
+};
+
+
+#endif // DISK_PARTITIONS_H
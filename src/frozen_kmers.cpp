@@ -0,0 +1,69 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "frozen_kmers.h"
+
+#include <algorithm>
+
+
+FrozenKmers::FrozenKmers(const std::unordered_map<uint32_t, int> & kmers, int threads) :
+    m_live_count(kmers.size())
+{
+    m_records.reserve(kmers.size());
+    for (auto & kv : kmers)
+        m_records.push_back({kv.first, kv.second});
+    std::sort(m_records.begin(), m_records.end(), [](const KmerRecord & a, const KmerRecord & b) {
+        return a.kmer < b.kmer;
+    });
+    m_removed.assign((m_records.size() + 63) / 64, 0);
+
+    std::vector<uint32_t> keys;
+    keys.reserve(m_records.size());
+    for (auto & record : m_records)
+        keys.push_back(record.kmer);
+    m_hash = KmerHash(keys, threads);
+    m_slot_records.resize(m_records.size());
+    for (size_t i = 0; i < m_records.size(); ++i)
+        m_slot_records[m_hash.lookup(m_records[i].kmer)] = uint32_t(i);
+}
+
+
+size_t FrozenKmers::find(uint32_t kmer) const {
+    size_t slot = m_hash.lookup(kmer);
+    if (slot == KmerHash::NOT_FOUND)
+        return NOT_FOUND;
+    size_t record = m_slot_records[slot];
+    if (m_records[record].kmer != kmer || is_removed(record))
+        return NOT_FOUND;
+    return record;
+}
+
+
+int FrozenKmers::get_depth(uint32_t kmer) const {
+    size_t record = find(kmer);
+    return (record == NOT_FOUND) ? 0 : m_records[record].depth;
+}
+
+
+// Returns false if the k-mer wasn't there (or was already removed).
+bool FrozenKmers::erase(uint32_t kmer) {
+    size_t record = find(kmer);
+    if (record == NOT_FOUND)
+        return false;
+    m_removed[record / 64] |= uint64_t(1) << (record % 64);
+    --m_live_count;
+    return true;
+}
@@ -0,0 +1,67 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef FROZEN_KMERS_H
+#define FROZEN_KMERS_H
+
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "kmer_hash.h"
+
+
+struct KmerRecord
+{
+    uint32_t kmer;
+    int depth;
+};
+
+
+// The k-mer table once the low-depth filter is done. From then on, k-mers are only ever removed, so the survivors are
+// kept as one sorted array of records, with removals marked in a bitmap. Lookups go through a minimal perfect hash
+// of the k-mers to the index of their record, and the record itself holds both the k-mer (to confirm the match) and
+// its depth.
+class FrozenKmers
+{
+public:
+    FrozenKmers() : m_live_count(0) {}
+    FrozenKmers(const std::unordered_map<uint32_t, int> & kmers, int threads = 1);
+
+    static const size_t NOT_FOUND = size_t(-1);
+
+    size_t find(uint32_t kmer) const;
+    bool contains(uint32_t kmer) const {return find(kmer) != NOT_FOUND;}
+    int get_depth(uint32_t kmer) const;
+    bool erase(uint32_t kmer);
+
+    // Records are in k-mer order, including removed ones, so callers walking them should check is_removed.
+    size_t get_record_count() const {return m_records.size();}
+    const KmerRecord & get_record(size_t i) const {return m_records[i];}
+    bool is_removed(size_t i) const {return (m_removed[i / 64] >> (i % 64)) & 1;}
+    size_t size() const {return m_live_count;}
+
+private:
+    std::vector<KmerRecord> m_records;
+    KmerHash m_hash;
+    std::vector<uint32_t> m_slot_records;
+    std::vector<uint64_t> m_removed;
+    size_t m_live_count;
+};
+
+
+#endif // FROZEN_KMERS_H
@@ -0,0 +1,125 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "kmer_hash.h"
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+
+// Each level's bit array is this many times as long as the number of k-mers it has to place. Longer arrays place more
+// k-mers at the first level, so lookups are faster, at the cost of a few more bits per k-mer.
+#define BITS_PER_KMER 2.0
+
+// K-mers still unplaced after this many levels go in an ordinary hash map (there are almost never any).
+#define MAX_LEVELS 32
+
+// Set bits are counted ahead of time at the start of every block of this many 64-bit words.
+#define WORDS_PER_RANK 8
+
+// Below this many k-mers per thread, it isn't worth starting another thread.
+#define MIN_KMERS_PER_THREAD 4096
+
+
+KmerHash::KmerHash(const std::vector<uint32_t> & kmers, int threads) :
+    m_size(kmers.size())
+{
+    std::vector<uint32_t> remaining(kmers);
+    std::vector<uint32_t> next_remaining;
+    for (size_t level = 0; level < MAX_LEVELS && !remaining.empty(); ++level) {
+        size_t word_count = (size_t(remaining.size() * BITS_PER_KMER) + 63) / 64;
+        size_t bit_count = word_count * 64;
+        std::vector<std::atomic<uint64_t>> hit(word_count), collided(word_count);
+        for (size_t i = 0; i < word_count; ++i) {
+            hit[i].store(0);
+            collided[i].store(0);
+        }
+
+        // The k-mers are hashed on all threads. Setting a bit with fetch_or says whether another k-mer got there
+        // first, so collisions are found without locks, and the result doesn't depend on the order.
+        auto hash_range = [&](size_t range_start, size_t range_end) {
+            for (size_t i = range_start; i < range_end; ++i) {
+                size_t position = get_position(remaining[i], level, bit_count);
+                uint64_t bit = uint64_t(1) << (position % 64);
+                if (hit[position / 64].fetch_or(bit, std::memory_order_relaxed) & bit)
+                    collided[position / 64].fetch_or(bit, std::memory_order_relaxed);
+            }
+        };
+        size_t count = remaining.size();
+        size_t thread_count = std::min(size_t(std::max(threads, 1)), count / MIN_KMERS_PER_THREAD + 1);
+        std::vector<std::thread> hash_threads;
+        for (size_t t = 1; t < thread_count; ++t)
+            hash_threads.push_back(std::thread(hash_range, count * t / thread_count, count * (t + 1) / thread_count));
+        hash_range(0, count / thread_count);
+        for (auto & thread : hash_threads)
+            thread.join();
+
+        m_levels.push_back({m_bits.size(), bit_count});
+        for (size_t i = 0; i < word_count; ++i)
+            m_bits.push_back(hit[i].load() & ~collided[i].load());
+
+        next_remaining.clear();
+        for (auto kmer : remaining) {
+            size_t position = get_position(kmer, level, bit_count);
+            if (collided[position / 64].load() & (uint64_t(1) << (position % 64)))
+                next_remaining.push_back(kmer);
+        }
+        remaining.swap(next_remaining);
+    }
+
+    uint64_t rank = 0;
+    for (size_t i = 0; i < m_bits.size(); ++i) {
+        if (i % WORDS_PER_RANK == 0)
+            m_ranks.push_back(rank);
+        rank += __builtin_popcountll(m_bits[i]);
+    }
+    for (auto kmer : remaining)
+        m_leftovers[kmer] = size_t(rank++);
+}
+
+
+// A 64-bit mix of the k-mer and level (the splitmix64 finaliser), scaled onto the level's bits.
+size_t KmerHash::get_position(uint32_t kmer, size_t level, size_t bit_count) {
+    uint64_t x = (uint64_t(kmer) << 8) ^ (uint64_t(level) * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x = x ^ (x >> 31);
+    return size_t(x % bit_count);
+}
+
+
+size_t KmerHash::get_rank(size_t bit) const {
+    size_t word = bit / 64;
+    size_t block = word / WORDS_PER_RANK;
+    size_t rank = size_t(m_ranks[block]);
+    for (size_t i = block * WORDS_PER_RANK; i < word; ++i)
+        rank += __builtin_popcountll(m_bits[i]);
+    uint64_t below = (uint64_t(1) << (bit % 64)) - 1;
+    return rank + __builtin_popcountll(m_bits[word] & below);
+}
+
+
+size_t KmerHash::lookup(uint32_t kmer) const {
+    for (size_t level = 0; level < m_levels.size(); ++level) {
+        size_t position = get_position(kmer, level, m_levels[level].bit_count);
+        size_t bit = m_levels[level].first_word * 64 + position;
+        if (m_bits[bit / 64] & (uint64_t(1) << (bit % 64)))
+            return get_rank(bit);
+    }
+    auto leftover = m_leftovers.find(kmer);
+    return (leftover == m_leftovers.end()) ? NOT_FOUND : leftover->second;
+}
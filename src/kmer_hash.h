@@ -0,0 +1,63 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef KMER_HASH_H
+#define KMER_HASH_H
+
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+
+// A minimal perfect hash function for a fixed set of k-mers, built as in BBHash: each level is a bit array about
+// twice as long as the number of k-mers it has to place. A k-mer is placed at the level where it is the only one to
+// hash to its bit, and k-mers which collide with another try again at the next level. A placed k-mer's slot is the
+// number of set bits before its bit. Slots run from 0 to size-1 with no gaps, so a table indexed by slot needs no
+// empty entries, and the function itself takes only a few bits per k-mer.
+//
+// A k-mer which isn't in the set gets an arbitrary slot (or NOT_FOUND), so whatever is stored in the slot has to be
+// checked to confirm a match.
+class KmerHash
+{
+public:
+    KmerHash() : m_size(0) {}
+    KmerHash(const std::vector<uint32_t> & kmers, int threads = 1);
+
+    static const size_t NOT_FOUND = size_t(-1);
+
+    size_t lookup(uint32_t kmer) const;
+    size_t size() const {return m_size;}
+
+private:
+    struct Level
+    {
+        size_t first_word;
+        size_t bit_count;
+    };
+
+    std::vector<Level> m_levels;
+    std::vector<uint64_t> m_bits;
+    std::vector<uint64_t> m_ranks;
+    std::unordered_map<uint32_t, size_t> m_leftovers;
+    size_t m_size;
+
+    static size_t get_position(uint32_t kmer, size_t level, size_t bit_count);
+    size_t get_rank(size_t bit) const;
+};
+
+
+#endif // KMER_HASH_H
@@ -0,0 +1,35 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "kmer_set.h"
+
+#include <algorithm>
+
+
+KmerSet::KmerSet(std::vector<uint32_t> kmers, int threads) {
+    std::sort(kmers.begin(), kmers.end());
+    kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+    m_hash = KmerHash(kmers, threads);
+    m_kmers.resize(kmers.size());
+    for (auto kmer : kmers)
+        m_kmers[m_hash.lookup(kmer)] = kmer;
+}
+
+
+bool KmerSet::contains(uint32_t kmer) const {
+    size_t slot = m_hash.lookup(kmer);
+    return slot != KmerHash::NOT_FOUND && m_kmers[slot] == kmer;
+}
@@ -0,0 +1,45 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef KMER_SET_H
+#define KMER_SET_H
+
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "kmer_hash.h"
+
+
+// A fixed set of k-mers (e.g. the cleaned adapter k-mers) for fast lookups while streaming reads. The k-mers are kept
+// in an array ordered by a minimal perfect hash, so a lookup checks just the one entry the k-mer hashes to. It is
+// much smaller than a hash map and can be shared by any number of threads.
+class KmerSet
+{
+public:
+    KmerSet() {}
+    KmerSet(std::vector<uint32_t> kmers, int threads = 1);
+
+    bool contains(uint32_t kmer) const;
+    size_t size() const {return m_kmers.size();}
+
+private:
+    KmerHash m_hash;
+    std::vector<uint32_t> m_kmers;
+};
+
+
+#endif // KMER_SET_H
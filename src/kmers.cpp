@@ -18,81 +18,653 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <zlib.h>
+#include <climits>
+#include <iomanip>
+#include <functional>
+#include <thread>
 #include "kseq.h"
 #include "misc.h"
+#include "count_file.h"
+#include "barcodes.h"
 
 KSEQ_INIT(gzFile, gzread)
 
+#define CONVERGENCE_BATCH 10000
+#define CONVERGENCE_STABLE_BATCHES 3
+
+// Rough memory cost of one k-mer in the counting hash map, and a cap on the number of partition files open at once.
+#define BYTES_PER_TABLE_KMER 48
+#define MAX_DISK_PARTITIONS 256
+
+// Below this many k-mers per thread, it isn't worth starting another thread for a cleaning pass.
+#define MIN_ITEMS_PER_THREAD 4096
+
+// How far (in bases) adjacent k-mers' mean offsets may differ beyond the expected one base when extending adapters.
+#define MAX_OFFSET_SHIFT 5.0
+
 
 Kmers::Kmers(int kmer_size) {
     m_kmer_size = size_t(kmer_size);
+    m_kmer_mask = (m_kmer_size == 16) ? 0xffffffff : (uint32_t(1) << (2 * m_kmer_size)) - 1;
+    m_threads = 1;
+    m_positional = false;
+    m_distinct = false;
+    m_start = true;
+    m_end = false;
+    m_canonical = false;
+    m_margin = 0;
+    m_mode_set = false;
+    m_count_files_loaded = 0;
+    m_shard_index = 0;
+    m_shard_count = 1;
+    m_read_count = 0;
+    m_max_reads = 0;
+    m_sample_fraction = 1.0;
+    m_converge = false;
+    m_converge_filter_depth = 0.0;
+    m_converge_tolerance = 0.0;
+    m_stable_batches = 0;
+    m_quiet = false;
+    m_frozen = false;
+    m_progress = NULL;
+    m_progress_counters = NULL;
+}
+
+
+// Discards the counts so the same object can be used for another set of reads. The cleaning buffers are kept, so a
+// table reused between similar samples doesn't have to grow them again.
+void Kmers::clear() {
+    m_kmers.clear();
+    m_frozen_kmers = FrozenKmers();
+    m_frozen = false;
+    for (auto cluster : m_clusters)
+        cluster->clear();
+    m_positions.clear();
+    m_disk.reset();
+    m_start = true;
+    m_end = false;
+    m_margin = 0;
+    m_mode_set = false;
+    m_count_files_loaded = 0;
+    m_shard_index = 0;
+    m_shard_count = 1;
+    m_shard_read_counts.clear();
+    m_read_count = 0;
+    m_stable_batches = 0;
+    m_last_profile.clear();
+}
+
+
+// Sends progress messages to the callback, one line at a time, instead of stderr.
+void Kmers::set_log_callback(LogCallback callback) {
+    m_log_buffer = std::make_shared<CallbackBuffer>(callback);
+    m_log_stream = std::make_shared<std::ostream>(m_log_buffer.get());
+}
+
+
+// While hashing with a reporter, reads are counted in the reporter's totals, and messages go through it instead of
+// stderr so they don't break up its status line. Passing NULL goes back to per-file progress.
+void Kmers::set_progress(ProgressReporter * progress) {
+    m_progress = progress;
+    m_progress_counters = progress ? progress->add_counters() : NULL;
+}
+
+
+// Returns a copy with only the k-mers at or above min_depth. When most of the table is low-depth noise (as it is
+// before cleaning), this is much faster than copying everything and then filtering.
+Kmers Kmers::get_filtered_copy(int min_depth) {
+    Kmers copy = get_bare_copy();
+    for (auto kv : m_kmers) {
+        if (kv.second < min_depth)
+            continue;
+        copy.m_kmers.insert(kv);
+        auto position = m_positions.find(kv.first);
+        if (position != m_positions.end())
+            copy.m_positions.insert(*position);
+    }
+    return copy;
+}
+
+
+// Returns a copy of a frozen table, to be cleaned separately (e.g. for each --sweep fraction). The offset stats are
+// inserted afresh, so the copy's hash map is sized for the k-mers left rather than the raw table.
+Kmers Kmers::get_frozen_copy() {
+    Kmers copy = get_bare_copy();
+    copy.m_positions.insert(m_positions.begin(), m_positions.end());
+    return copy;
+}
+
+
+// Copies everything except the hash maps and the cleaning buffers. These are sized for the raw table, so they can
+// be much bigger than a copy needs.
+Kmers Kmers::get_bare_copy() {
+    std::unordered_map<uint32_t, int> all_kmers;
+    std::unordered_map<uint32_t, PositionStats> all_positions;
+    CleaningScratch scratch = CleaningScratch();
+    all_kmers.swap(m_kmers);
+    all_positions.swap(m_positions);
+    std::swap(scratch, m_scratch);
+    Kmers copy(*this);
+    all_kmers.swap(m_kmers);
+    all_positions.swap(m_positions);
+    std::swap(scratch, m_scratch);
+    return copy;
 }
 
 
-void Kmers::add_fastq(std::string filename, bool start, int margin) {
+// Progress messages go here, so they can be silenced when several tables are being filled at once, or passed to a
+// callback. Errors always go to stderr (through the progress reporter, if there is one). Quiet tables are often
+// filled on several threads at once, so each thread has its own null stream to format into.
+std::ostream & Kmers::log() {
+    static thread_local NullBuffer null_buffer;
+    static thread_local std::ostream null_stream(&null_buffer);
+    if (m_quiet)
+        return null_stream;
+    if (m_progress)
+        return m_progress->log();
+    return m_log_stream ? *m_log_stream : std::cerr;
+}
+
+
+int CallbackBuffer::overflow(int c) {
+    if (c == '\n' || c == '\r') {
+        if (!m_line.empty())
+            m_callback(m_line);
+        m_line.clear();
+    }
+    else if (c != EOF)
+        m_line += char(c);
+    return c;
+}
+
+
+// A max_reads of 0 means no limit. Subsampling is decided by a hash of the read name, so the same reads are chosen
+// on every run.
+void Kmers::set_read_limit(long long max_reads, double sample_fraction) {
+    m_max_reads = max_reads;
+    m_sample_fraction = sample_fraction;
+}
 
-    std::cerr << "Hashing " << m_kmer_size << "-mers from " << filename;
-    if (start)
-        std::cerr << " starts\n";
+
+void Kmers::set_convergence(double filter_depth, double tolerance) {
+    m_converge = true;
+    m_converge_filter_depth = filter_depth;
+    m_converge_tolerance = tolerance;
+    m_stable_batches = 0;
+    m_last_profile.clear();
+}
+
+
+// Returns false if hashing stopped early (read limit reached or the graph converged), in which case there is no need
+// to hash any more files.
+bool Kmers::add_fastq(std::string filename, bool start, bool end, int margin) {
+
+    log() << "Hashing " << (m_canonical ? "canonical " : "") << m_kmer_size << "-mers from " << filename;
+    if (start && end)
+        log() << " starts and ends\n";
+    else if (start)
+        log() << " starts\n";
     else  // end
-        std::cerr << " ends\n";
+        log() << " ends\n";
+
+    m_start = start;
+    m_end = end;
+    m_margin = std::max(m_margin, margin);
+    m_mode_set = true;
+    for (auto cluster : m_clusters) {
+        cluster->m_start = start;
+        cluster->m_end = end;
+        cluster->m_margin = m_margin;
+        cluster->m_mode_set = true;
+    }
 
     int l;
     int sequence_count = 0;
+    bool keep_going = true;
 
     long long base_count = 0;
-    long long last_progress = 0;
+    ProgressThrottle progress;
 
     gzFile fp = gzopen(filename.c_str(), "r");
     kseq_t * seq = kseq_init(fp);
-    while ((l = kseq_read(seq)) >= 0) {
-        if (l == -3)
-            std::cerr << "Error reading " << filename << "\n";
+    long long input_start = m_progress_counters ? m_progress_counters->input_bytes.load() : 0;
+    while (keep_going && (l = kseq_read(seq)) >= 0) {
+        if (l == -3) {
+            if (m_progress)
+                m_progress->print("Error reading " + filename + "\n");
+            else
+                std::cerr << "Error reading " << filename << "\n";
+        }
         else {
+            if (m_sample_fraction < 1.0 && !is_read_sampled(seq->name.s))
+                continue;
             ++sequence_count;
 
             base_count += seq->seq.l;
-            char * sequence = seq->seq.s;
-
-            int range_start, range_end;
-            if (start) {
-                range_start = 0;
-                range_end = std::min(margin, int(seq->seq.l)) + 1 - int(m_kmer_size);
+            if (m_barcodes)
+                add_barcoded_read(seq->seq.s, int(seq->seq.l), start, end, margin);
+            else
+                add_read(seq->seq.s, int(seq->seq.l), start, end, margin);
+
+            if (m_progress_counters) {
+                m_progress_counters->add_reads(1, (long long)seq->seq.l);
+                if (sequence_count % 64 == 0)
+                    m_progress_counters->set_input_bytes(input_start + gzoffset(fp));
             }
-            else {  // end
-                range_start = std::max(int(seq->seq.l) - margin, 0);
-                range_end = int(seq->seq.l) + 1 - int(m_kmer_size);
-            }
-
-            for (int i = range_start; i < range_end; ++i)
-                add_kmer(kmer_to_bits(sequence + i));
+            else if (progress.ready())
+                print_hash_progress(log(), filename, base_count);
 
-            if (base_count - last_progress >= 483611) {  // a big prime number so progress updates don't round off
-                last_progress = base_count;
-                print_hash_progress(filename, base_count);
+            if (m_max_reads > 0 && m_read_count >= m_max_reads) {
+                keep_going = false;
+                print_hash_progress(log(), filename, base_count);
+                log() << "\n  stopping: reached " << int_to_string(m_max_reads) << " reads";
+            }
+            else if (m_converge && m_read_count % CONVERGENCE_BATCH == 0 && has_converged()) {
+                keep_going = false;
+                print_hash_progress(log(), filename, base_count);
+                log() << "\n  stopping: graph converged after " << int_to_string(m_read_count) << " reads";
             }
         }
     }
+    if (m_progress_counters)
+        m_progress_counters->set_input_bytes(input_start + gzoffset(fp));
     kseq_destroy(seq);
     gzclose(fp);
-    print_hash_progress(filename, base_count);
+    if (keep_going)
+        print_hash_progress(log(), filename, base_count);
+
+    log() << "\n  " << int_to_string(sequence_count) << " reads, ";
+    if (m_disk)
+        log() << int_to_string(m_disk->get_kmer_count()) << " " << m_kmer_size << "-mers written to disk\n\n";
+    else if (m_barcodes) {
+        int classified = 0;
+        for (size_t i = 0; i + 1 < m_clusters.size(); ++i)
+            classified += int(m_clusters[i]->m_read_count);
+        log() << int_to_string(classified) << " with a barcode\n\n";
+    }
+    else
+        log() << int_to_string(int(m_kmers.size())) << " " << m_kmer_size << "-mers\n\n";
+    return keep_going;
+}
 
-    std::cerr << "\n  " << int_to_string(sequence_count) << " reads, "
-              << int_to_string(int(m_kmers.size())) << " " << m_kmer_size << "-mers\n\n";
+
+// Creates a table for each barcode, plus one for unclassified reads, with the same settings as this one. Call this
+// after the other settings.
+bool Kmers::set_barcodes(std::string filename) {
+    m_barcodes = std::make_shared<BarcodeClassifier>(int(m_kmer_size));
+    if (!m_barcodes->load(filename))
+        return false;
+    m_clusters.clear();
+    for (int i = 0; i <= m_barcodes->get_barcode_count(); ++i) {
+        auto cluster = std::make_shared<Kmers>(int(m_kmer_size));
+        cluster->set_threads(m_threads);
+        cluster->set_positional(m_positional);
+        cluster->set_distinct(m_distinct);
+        cluster->set_canonical(m_canonical);
+        cluster->set_quiet(true);
+        m_clusters.push_back(cluster);
+    }
+    return true;
 }
 
 
-void Kmers::add_kmer(uint32_t kmer) {
-    if (!is_kmer_present(kmer))
-        m_kmers[kmer] = 1;
+std::string Kmers::get_cluster_name(int cluster) {
+    if (cluster < m_barcodes->get_barcode_count())
+        return m_barcodes->get_name(cluster);
+    return "unclassified";
+}
+
+
+void Kmers::add_barcoded_read(const char * sequence, int length, bool start, bool end, int margin) {
+    int barcode = m_barcodes->classify(sequence, length, start, end, margin);
+    Kmers & cluster = (barcode < 0) ? *m_clusters.back() : *m_clusters[barcode];
+    cluster.add_read(sequence, length, start, end, margin);
+    ++m_read_count;
+}
+
+
+// When both read starts and ends are used, the end window begins no earlier than where the start window finished,
+// so short reads don't have any k-mers counted twice. With --distinct, both windows share one set of seen k-mers, so
+// a canonical k-mer found in both is still only counted once. The read mode is recorded here as well as in add_fastq,
+// as library users add reads directly and the positional filter and count files depend on it.
+void Kmers::add_read(const char * sequence, int length, bool start, bool end, int margin) {
+    m_start = start;
+    m_end = end;
+    m_margin = std::max(m_margin, margin);
+    m_mode_set = true;
+    if (m_distinct)
+        m_read_kmers.start_read(length + 1 - int(m_kmer_size));
+    int start_range_end = 0;
+    if (start) {
+        start_range_end = std::max(std::min(margin, length) + 1 - int(m_kmer_size), 0);
+        add_read_range(sequence, length, 0, start_range_end, true);
+    }
+    if (end) {
+        int range_start = std::max(std::max(length - margin, 0), start_range_end);
+        add_read_range(sequence, length, range_start, length + 1 - int(m_kmer_size), false);
+    }
+    ++m_read_count;
+}
+
+
+void Kmers::add_read_range(const char * sequence, int length, int range_start, int range_end, bool start) {
+    for (int i = range_start; i < range_end; ++i) {
+        uint32_t kmer = get_key(kmer_to_bits(sequence + i));
+        if (m_distinct && !m_read_kmers.insert(kmer))
+            continue;
+        add_kmer(kmer);
+        if (m_positional)
+            add_position(kmer, start ? i : length - int(m_kmer_size) - i);
+    }
+}
+
+
+// The table has at least twice as many slots as the read can have k-mers, so probes stay short.
+void ReadKmerSet::start_read(int max_kmers) {
+    size_t slots = 16;
+    while (slots < size_t(std::max(max_kmers, 0)) * 2)
+        slots *= 2;
+    ++m_generation;
+    if (slots > m_stamps.size() || m_generation == 0) {
+        m_kmers.assign(std::max(slots, m_kmers.size()), 0);
+        m_stamps.assign(m_kmers.size(), 0);
+        m_mask = uint32_t(m_kmers.size() - 1);
+        m_generation = 1;
+    }
+}
+
+
+// Returns false if the k-mer was already in the set.
+bool ReadKmerSet::insert(uint32_t kmer) {
+    uint32_t slot = (kmer * 2654435761u) & m_mask;
+    while (m_stamps[slot] == m_generation) {
+        if (m_kmers[slot] == kmer)
+            return false;
+        slot = (slot + 1) & m_mask;
+    }
+    m_stamps[slot] = m_generation;
+    m_kmers[slot] = kmer;
+    return true;
+}
+
+
+// Offsets are counted from the read end being assembled. They are summarised with Welford's running mean and sum of
+// squared differences, so each k-mer only needs two floats however many times it occurs.
+void Kmers::add_position(uint32_t kmer, int offset) {
+    PositionStats & stats = m_positions[kmer];
+    int count = m_kmers[kmer];
+    float delta = float(offset) - stats.mean;
+    stats.mean += delta / count;
+    stats.m2 += delta * (float(offset) - stats.mean);
+}
+
+
+// Returns -1 if the k-mer has no offset information.
+double Kmers::get_offset_sd(uint32_t kmer) const {
+    auto found = m_positions.find(get_key(kmer));
+    int count = get_depth(kmer);
+    if (found == m_positions.end() || count < 2)
+        return -1.0;
+    return std::sqrt(found->second.m2 / (count - 1));
+}
+
+
+// FNV-1a hash of the read name, scaled to [0, 1).
+bool Kmers::is_read_sampled(const char * name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char * c = name; *c != '\0'; ++c) {
+        hash ^= uint64_t(static_cast<unsigned char>(*c));
+        hash *= 1099511628211ULL;
+    }
+    double position = double(hash >> 11) / double(1ULL << 53);
+    return position < m_sample_fraction;
+}
+
+
+// Compares the k-mers which would survive the depth filter (and their depths relative to the max depth) to the same
+// profile from the previous batch. The change is the number of k-mers which entered or left the set plus the total
+// change in relative depth of those which stayed, divided by the size of both sets combined. The graph is deemed
+// converged once this has stayed within the tolerance for a few batches in a row.
+bool Kmers::has_converged() {
+    int max_depth = get_max_depth();
+    if (max_depth == 0)
+        return false;
+    int filter_depth = int(max_depth * m_converge_filter_depth);
+
+    std::unordered_map<uint32_t, double> profile;
+    for (auto kv : m_kmers) {
+        if (kv.second >= filter_depth && kv.second > 0)
+            profile[kv.first] = double(kv.second) / max_depth;
+    }
+
+    double change = 0.0;
+    int union_size = int(m_last_profile.size());
+    for (auto kv : profile) {
+        auto previous = m_last_profile.find(kv.first);
+        if (previous == m_last_profile.end()) {
+            change += 1.0;
+            ++union_size;
+        }
+        else
+            change += std::abs(kv.second - previous->second);
+    }
+    for (auto kv : m_last_profile) {
+        if (profile.find(kv.first) == profile.end())
+            change += 1.0;
+    }
+    bool first_batch = m_last_profile.empty();
+    m_last_profile.swap(profile);
+    if (first_batch || union_size == 0)
+        return false;
+
+    if (change / union_size <= m_converge_tolerance)
+        ++m_stable_batches;
     else
-        ++m_kmers[kmer];
+        m_stable_batches = 0;
+    return m_stable_batches >= CONVERGENCE_STABLE_BATCHES;
 }
 
 
-bool Kmers::is_kmer_present(uint32_t kmer) {
-    return m_kmers.find(kmer) != m_kmers.end();
+bool Kmers::save_counts(std::string filename) {
+    std::vector<std::pair<uint32_t, uint32_t>> sorted_counts;
+    sorted_counts.reserve(m_kmers.size());
+    for (auto kv : m_kmers)
+        sorted_counts.push_back(std::pair<uint32_t, uint32_t>(kv.first, uint32_t(kv.second)));
+    std::sort(sorted_counts.begin(), sorted_counts.end());
+
+    CountFileHeader header = get_count_file_header();
+    header.max_depth = uint32_t(get_max_depth());
+    return write_count_file(filename, header, sorted_counts);
+}
+
+
+// Splits the table into shard_count files named PREFIX.0, PREFIX.1, etc., each holding the k-mers which hash to that
+// shard.
+bool Kmers::save_sharded_counts(std::string prefix, int shard_count) {
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> shards(shard_count);
+    for (auto kv : m_kmers) {
+        uint32_t shard = get_kmer_shard(kv.first, uint32_t(shard_count));
+        shards[shard].push_back(std::pair<uint32_t, uint32_t>(kv.first, uint32_t(kv.second)));
+    }
+
+    for (int i = 0; i < shard_count; ++i) {
+        std::sort(shards[i].begin(), shards[i].end());
+        CountFileHeader header = get_count_file_header();
+        header.max_depth = 0;
+        for (auto kv : shards[i])
+            header.max_depth = std::max(header.max_depth, kv.second);
+        header.shard_index = uint32_t(i);
+        header.shard_count = uint32_t(shard_count);
+        if (!write_count_file(prefix + "." + std::to_string(i), header, shards[i]))
+            return false;
+    }
+    return true;
+}
+
+
+CountFileHeader Kmers::get_count_file_header() {
+    CountFileHeader header;
+    header.kmer_size = uint32_t(m_kmer_size);
+    header.start = m_start;
+    header.end = m_end;
+    header.canonical = m_canonical;
+    header.margin = uint32_t(m_margin);
+    header.read_count = uint64_t(m_read_count);
+    header.max_depth = 0;
+    header.shard_index = m_shard_index;
+    header.shard_count = m_shard_count;
+    return header;
+}
+
+
+// Adds the counts in the file to the table, so loading several files merges them. K-mers with a count below
+// min_depth are skipped, which is only safe if no other file being loaded can contain the same k-mers (i.e. they
+// are different shards).
+bool Kmers::load_counts(std::string filename, int min_depth) {
+    std::ifstream in(filename, std::ios::binary);
+    CountFileHeader header;
+    if (!read_count_file_header(in, filename, header))
+        return false;
+
+    if (header.kmer_size != m_kmer_size) {
+        std::cerr << "Error: " << filename << " contains " << header.kmer_size << "-mers, expected "
+                  << m_kmer_size << "-mers\n";
+        return false;
+    }
+    if (m_mode_set && (header.start != m_start || header.end != m_end)) {
+        std::cerr << "Error: cannot combine counts from different read ends (" << filename << ")\n";
+        return false;
+    }
+    if (m_mode_set && header.canonical != m_canonical) {
+        std::cerr << "Error: cannot combine canonical and non-canonical counts (" << filename << ")\n";
+        return false;
+    }
+    if (m_mode_set && int(header.margin) != m_margin)
+        std::cerr << "Warning: " << filename << " was counted with a different --margin\n";
+
+    log() << "Loading " << m_kmer_size << "-mer counts from " << filename << "\n";
+    bool good = read_count_file_entries(in, filename, header, [this, min_depth](uint32_t kmer, uint32_t count) {
+        if (count >= uint32_t(min_depth))
+            add_count(kmer, count);
+    });
+    if (!good)
+        return false;
+
+    // A table combined from different shards is no longer a single shard.
+    if (m_count_files_loaded == 0) {
+        m_shard_index = header.shard_index;
+        m_shard_count = header.shard_count;
+    }
+    else if (header.shard_index != m_shard_index || header.shard_count != m_shard_count) {
+        m_shard_index = 0;
+        m_shard_count = 1;
+    }
+    ++m_count_files_loaded;
+
+    m_start = header.start;
+    m_end = header.end;
+    m_canonical = header.canonical;
+    m_margin = std::max(m_margin, int(header.margin));
+    m_mode_set = true;
+
+    // Every shard of a table counts the same reads, so reads are only summed across files of the same shard.
+    if (header.shard_count == 1)
+        m_read_count += (long long)header.read_count;
+    else {
+        long long most_before = get_most_shard_reads();
+        m_shard_read_counts[header.shard_index] += (long long)header.read_count;
+        m_read_count += get_most_shard_reads() - most_before;
+    }
+
+    log() << "  " << int_to_string((long long)header.read_count) << " reads, "
+          << int_to_string(int(m_kmers.size())) << " " << m_kmer_size << "-mers\n\n";
+    return true;
+}
+
+
+long long Kmers::get_most_shard_reads() {
+    long long most = 0;
+    for (auto kv : m_shard_read_counts)
+        most = std::max(most, kv.second);
+    return most;
+}
+
+
+// Merged counts saturate rather than overflow.
+void Kmers::add_count(uint32_t kmer, uint32_t count) {
+    long long total = (long long)m_kmers[kmer] + count;
+    m_kmers[kmer] = int(std::min(total, (long long)INT_MAX));
+}
+
+
+// Sets up counting with a memory limit (in bytes). Instead of going into the table, hashed k-mers are written to
+// partitions on disk, which count_disk_partitions then counts one at a time. The number of partitions is chosen so
+// that one partition's share of all possible k-mers fits in about three quarters of the limit, with the rest used
+// for write buffers.
+bool Kmers::set_disk_counting(std::string temp_dir, long long max_memory) {
+    double possible_kmers = double(uint64_t(1) << (2 * m_kmer_size));
+    double table_memory = max_memory * 0.75;
+    double buffer_memory = max_memory - table_memory;
+    int partition_count = int(std::ceil(possible_kmers * BYTES_PER_TABLE_KMER / table_memory));
+    if (partition_count > MAX_DISK_PARTITIONS) {
+        double partition_memory = possible_kmers * BYTES_PER_TABLE_KMER / MAX_DISK_PARTITIONS + buffer_memory;
+        std::cerr << "Warning: " << m_kmer_size << "-mers need more than " << MAX_DISK_PARTITIONS
+                  << " disk partitions to stay within --max_memory, so counting one partition may use up to about "
+                  << int_to_string((long long)(partition_memory / 1000000.0)) << " MB\n\n";
+    }
+    partition_count = std::max(1, std::min(partition_count, MAX_DISK_PARTITIONS));
+    size_t buffer_kmers = std::max(size_t(1024), size_t(buffer_memory / partition_count / sizeof(uint32_t)));
+
+    m_disk = std::make_shared<DiskPartitions>(temp_dir, partition_count, buffer_kmers);
+    return m_disk->is_good();
+}
+
+
+// Counts the partitions written during disk-based counting. Each partition's k-mers are counted in their own table,
+// and only those with a depth of at least filter_fraction of that partition's max depth are kept. The overall max
+// depth can't be lower than a partition's, so this never drops a k-mer that would pass the overall depth filter.
+bool Kmers::count_disk_partitions(double filter_fraction) {
+    int partition_count = m_disk->get_partition_count();
+    log() << "Counting " << m_kmer_size << "-mers in " << partition_count << " disk partition"
+          << (partition_count == 1 ? "" : "s") << "\n";
+
+    std::unordered_map<uint32_t, int> counts;
+    for (int i = 0; i < partition_count; ++i) {
+        counts.clear();
+        if (!m_disk->count_partition(i, counts))
+            return false;
+        int max_depth = 0;
+        for (auto kv : counts)
+            max_depth = std::max(max_depth, kv.second);
+        int min_depth = int(max_depth * filter_fraction);
+        for (auto kv : counts) {
+            if (kv.second >= min_depth)
+                m_kmers[kv.first] = kv.second;
+        }
+        log() << "\r  partition " << i + 1 << " of " << partition_count;
+    }
+    m_disk.reset();
+
+    log() << "\n  " << int_to_string(int(m_kmers.size())) << " " << m_kmer_size << "-mers kept\n\n";
+    return true;
+}
+
+
+void Kmers::add_kmer(uint32_t kmer) {
+    if (m_disk) {
+        m_disk->add_kmer(kmer);
+        return;
+    }
+    ++m_kmers[kmer];
+}
+
+
+bool Kmers::is_kmer_present(uint32_t kmer) const {
+    if (m_frozen)
+        return m_frozen_kmers.contains(get_key(kmer));
+    return m_kmers.find(get_key(kmer)) != m_kmers.end();
 }
 
 
@@ -138,7 +710,7 @@ char Kmers::bits_to_base(uint32_t bits) {
 }
 
 
-uint32_t Kmers::kmer_to_bits(char * sequence) {
+uint32_t Kmers::kmer_to_bits(const char * sequence) {
     uint32_t kmer = 0;
     for (size_t i = 0; i < m_kmer_size; ++i) {
         kmer <<= 2;
@@ -168,185 +740,593 @@ std::string Kmers::bits_to_kmer(uint32_t bits) {
 }
 
 
-void Kmers::remove_low_depth_kmers(int min_depth) {
-    std::vector<uint32_t> kmers_to_remove;
-    for (auto kv : m_kmers) {
-        uint32_t kmer = kv.first;
-        int count = kv.second;
-        if (count < min_depth)
-            kmers_to_remove.push_back(kmer);
+// Runs all cleaning steps in order, returning the number of k-mers remaining after each.
+std::vector<CleaningStep> Kmers::clean(int filter_depth, int max_tip_length) {
+    std::vector<CleaningStep> steps;
+
+    remove_low_depth_kmers(filter_depth);
+    steps.push_back({"remove low-depth nodes", get_kmer_count()});
+
+    if (m_positional) {
+        remove_positional_outliers();
+        steps.push_back({"remove scattered nodes", get_kmer_count()});
     }
-    for (auto kmer : kmers_to_remove)
+
+    remove_tips(max_tip_length);
+    steps.push_back({"prune tips", get_kmer_count()});
+
+    pop_bubbles(int(m_kmer_size) * 2);
+    steps.push_back({"pop bubbles", get_kmer_count()});
+
+    remove_large_diff();
+    steps.push_back({"remove large differences", get_kmer_count()});
+
+    remove_singletons();
+    steps.push_back({"remove singletons", get_kmer_count()});
+
+    return steps;
+}
+
+
+void Kmers::remove_low_depth_kmers(int min_depth) {
+    remove_marked_kmers([min_depth](uint32_t, int count) {
+        return count < min_depth;
+    });
+    freeze();
+}
+
+
+// Moves the k-mers into the frozen table and frees the hash map. Its buckets are sized for the raw table, which is
+// usually far bigger than the cleaned one, so keeping them would hold on to that memory for the table's lifetime
+// (and in every copy of it).
+void Kmers::freeze() {
+    if (m_frozen)
+        return;
+    m_frozen_kmers = FrozenKmers(m_kmers, m_threads);
+    m_frozen = true;
+    std::unordered_map<uint32_t, int>().swap(m_kmers);
+}
+
+
+// Removes a k-mer (given by its key) along with its offset stats.
+void Kmers::erase_kmer(uint32_t kmer) {
+    if (m_frozen)
+        m_frozen_kmers.erase(kmer);
+    else
         m_kmers.erase(kmer);
+    m_positions.erase(kmer);
 }
 
 
-void Kmers::output_gfa() {
-    std::vector<uint32_t> all_kmers;
-    for (auto kv : m_kmers)
-        all_kmers.push_back(kv.first);
-    std::sort(all_kmers.begin(), all_kmers.end());
+// Fills entries with every k-mer and its depth: in k-mer order once the table is frozen, in no particular order
+// before.
+void Kmers::get_entries(std::vector<std::pair<uint32_t, int>> & entries) const {
+    if (!m_frozen) {
+        entries.assign(m_kmers.begin(), m_kmers.end());
+        return;
+    }
+    entries.clear();
+    entries.reserve(m_frozen_kmers.size());
+    for (size_t i = 0; i < m_frozen_kmers.get_record_count(); ++i) {
+        if (!m_frozen_kmers.is_removed(i))
+            entries.push_back({m_frozen_kmers.get_record(i).kmer, m_frozen_kmers.get_record(i).depth});
+    }
+}
+
+
+// Checks every k-mer with should_remove, spread over all threads, then removes those it returned true for. Removals
+// are only recorded (one flag per k-mer) until every k-mer has been checked, so every check sees the same graph and the
+// result doesn't depend on the number of threads.
+void Kmers::remove_marked_kmers(std::function<bool(uint32_t, int)> should_remove) {
+    std::vector<std::pair<uint32_t, int>> & entries = m_scratch.entries;
+    std::vector<char> & removed = m_scratch.flags;
+    get_entries(entries);
+    removed.assign(entries.size(), 0);
+
+    parallel_for(entries.size(), [&](size_t i) {
+        removed[i] = should_remove(entries[i].first, entries[i].second);
+    });
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (removed[i])
+            erase_kmer(entries[i].first);
+    }
+}
+
+
+// Calls function(i) for i from 0 to count-1, splitting the range into one contiguous chunk per thread. The function
+// must not change the table.
+void Kmers::parallel_for(size_t count, std::function<void(size_t)> function) {
+    auto run_range = [&function](size_t range_start, size_t range_end) {
+        for (size_t i = range_start; i < range_end; ++i)
+            function(i);
+    };
+    size_t thread_count = std::min(size_t(m_threads), count / MIN_ITEMS_PER_THREAD + 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < thread_count; ++t)
+        threads.push_back(std::thread(run_range, count * t / thread_count, count * (t + 1) / thread_count));
+    run_range(0, count / thread_count);
+    for (auto & thread : threads)
+        thread.join();
+}
+
 
-    for (auto kmer : all_kmers)
-        print_segment_line(kmer);
-    for (auto kmer : all_kmers) {
+// Segments are in k-mer order, and links are in the order of their first k-mer.
+AdapterGraph Kmers::get_graph() {
+    sort_kmers(m_scratch.sorted_kmers);
+
+    AdapterGraph graph;
+    graph.kmer_size = int(m_kmer_size);
+    GraphLink link;
+    for (auto kmer : m_scratch.sorted_kmers)
+        graph.segments.push_back({kmer, bits_to_kmer(kmer), get_depth(kmer)});
+    for (auto kmer : m_scratch.sorted_kmers) {
+        for (auto next : get_downstream_kmers(kmer)) {
+            if (get_link(kmer, next, link))
+                graph.links.push_back(link);
+        }
+        if (m_canonical) {
+            for (auto next : get_downstream_kmers(reverse_complement(kmer))) {
+                if (get_link(reverse_complement(kmer), next, link))
+                    graph.links.push_back(link);
+            }
+        }
+    }
+    return graph;
+}
+
+
+// Writes the same graph as get_graph, but line by line, without building it in memory first.
+void Kmers::output_gfa(std::ostream & out) {
+    sort_kmers(m_scratch.sorted_kmers);
+    for (auto kmer : m_scratch.sorted_kmers)
+        out << "S\t" << kmer << "\t" << bits_to_kmer(kmer) << "\tdp:f:" << get_depth(kmer) << "\n";
+
+    GraphLink link;
+    auto write_link = [&](uint32_t kmer_1, uint32_t kmer_2) {
+        if (!get_link(kmer_1, kmer_2, link))
+            return;
+        out << "L\t";
+        out << link.from << "\t" << (link.from_forward ? "+" : "-") << "\t";
+        out << link.to << "\t" << (link.to_forward ? "+" : "-") << "\t";
+        out << m_kmer_size - 1 << "M\t\n";
+    };
+    for (auto kmer : m_scratch.sorted_kmers) {
         for (auto next : get_downstream_kmers(kmer))
-            print_link_line(kmer, next);
+            write_link(kmer, next);
+        if (m_canonical) {
+            for (auto next : get_downstream_kmers(reverse_complement(kmer)))
+                write_link(reverse_complement(kmer), next);
+        }
     }
 }
 
 
-void Kmers::print_segment_line(uint32_t kmer) {
-    std::cout << "S\t" << kmer << "\t" << bits_to_kmer(kmer) << "\tdp:f:" << m_kmers[kmer] << "\n";
+// Fills kmers with the table's keys in ascending order, reusing its storage. A frozen table is already in order.
+void Kmers::sort_kmers(std::vector<uint32_t> & kmers) const {
+    kmers.clear();
+    if (m_frozen) {
+        kmers.reserve(m_frozen_kmers.size());
+        for (size_t i = 0; i < m_frozen_kmers.get_record_count(); ++i) {
+            if (!m_frozen_kmers.is_removed(i))
+                kmers.push_back(m_frozen_kmers.get_record(i).kmer);
+        }
+        return;
+    }
+    kmers.reserve(m_kmers.size());
+    for (auto & kv : m_kmers)
+        kmers.push_back(kv.first);
+    std::sort(kmers.begin(), kmers.end());
 }
 
 
-void Kmers::print_link_line(uint32_t kmer_1, uint32_t kmer_2) {
-    std::cout << "L\t";
-    std::cout << kmer_1 << "\t+\t";
-    std::cout << kmer_2 << "\t+\t";
-    uint32_t overlap = m_kmer_size - 1;
-    std::cout << overlap << "M\t\n";
+// Finds a key's index in the scratch space's sorted snapshot of the table. The key must be in the snapshot.
+size_t Kmers::get_sorted_index(uint32_t kmer) const {
+    const std::vector<uint32_t> & kmers = m_scratch.sorted_kmers;
+    return size_t(std::lower_bound(kmers.begin(), kmers.end(), kmer) - kmers.begin());
 }
 
 
-std::vector<uint32_t> Kmers::get_upstream_kmers(uint32_t kmer) {
-    std::string kmer_string = bits_to_kmer(kmer);
-    kmer_string.pop_back();
+// Returns every k-mer in the table as it can appear in a read: in canonical mode, each entry stands for both a k-mer
+// and its reverse complement.
+std::vector<uint32_t> Kmers::get_oriented_kmers() {
+    std::vector<std::pair<uint32_t, int>> entries;
+    get_entries(entries);
+    std::vector<uint32_t> kmers;
+    for (auto kv : entries) {
+        kmers.push_back(kv.first);
+        if (m_canonical && reverse_complement(kv.first) != kv.first)
+            kmers.push_back(reverse_complement(kv.first));
+    }
+    return kmers;
+}
 
-    std::string next_1 = 'A' + kmer_string;
-    std::string next_2 = 'C' + kmer_string;
-    std::string next_3 = 'G' + kmer_string;
-    std::string next_4 = 'T' + kmer_string;
 
-    uint32_t next_1_bits = kmer_to_bits(next_1);
-    uint32_t next_2_bits = kmer_to_bits(next_2);
-    uint32_t next_3_bits = kmer_to_bits(next_3);
-    uint32_t next_4_bits = kmer_to_bits(next_4);
+// Adapters are extracted greedily: starting from the deepest k-mer not yet used, the path is extended in both
+// directions, always to the deepest unused neighbour, until it reaches a dead end. This repeats until every k-mer is
+// used. Paths shorter than k k-mers (i.e. sequences shorter than 2k-1 bases) are left out, and the rest are sorted
+// by total depth.
+std::vector<AdapterPath> Kmers::get_adapter_paths() {
+    std::vector<std::pair<uint32_t, int>> entries;
+    get_entries(entries);
+    std::vector<std::pair<int, uint32_t>> seeds;
+    for (auto kv : entries)
+        seeds.push_back(std::pair<int, uint32_t>(kv.second, kv.first));
+    std::sort(seeds.begin(), seeds.end(), [](const std::pair<int, uint32_t> & a, const std::pair<int, uint32_t> & b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::unordered_map<uint32_t, bool> used;
+    std::vector<std::pair<long long, AdapterPath>> paths;
+    for (auto seed : seeds) {
+        uint32_t seed_kmer = seed.second;
+        if (used[seed_kmer])
+            continue;
+        used[seed_kmer] = true;
+
+        std::vector<uint32_t> path = extend_path(seed_kmer, false, used);
+        std::reverse(path.begin(), path.end());
+        path.push_back(seed_kmer);
+        std::vector<uint32_t> downstream = extend_path(seed_kmer, true, used);
+        path.insert(path.end(), downstream.begin(), downstream.end());
+        if (path.size() < m_kmer_size)
+            continue;
+
+        AdapterPath adapter;
+        adapter.sequence = bits_to_kmer(path[0]);
+        long long total_depth = 0;
+        int max_depth = 0;
+        for (size_t i = 0; i < path.size(); ++i) {
+            if (i > 0)
+                adapter.sequence.push_back(bits_to_base(path[i] & 3));
+            int depth = get_depth(path[i]);
+            adapter.depths.push_back(depth);
+            total_depth += depth;
+            max_depth = std::max(max_depth, depth);
+        }
+        adapter.mean_depth = double(total_depth) / path.size();
+        auto first_position = m_positions.find(get_key(path[0]));
+        adapter.offset = (first_position == m_positions.end()) ? -1.0 : first_position->second.mean;
+        adapter.start_confidence = double(adapter.depths.front()) / max_depth;
+        adapter.end_confidence = double(adapter.depths.back()) / max_depth;
+        paths.push_back(std::pair<long long, AdapterPath>(total_depth, adapter));
+    }
 
-    std::vector<uint32_t> upstream_kmers;
+    std::stable_sort(paths.begin(), paths.end(), [](const std::pair<long long, AdapterPath> & a,
+                                                    const std::pair<long long, AdapterPath> & b) {
+        return a.first > b.first;
+    });
+    std::vector<AdapterPath> adapters;
+    for (auto & path : paths)
+        adapters.push_back(path.second);
+    return adapters;
+}
 
-    if (is_kmer_present(next_1_bits))
-        upstream_kmers.push_back(next_1_bits);
-    if (is_kmer_present(next_2_bits))
-        upstream_kmers.push_back(next_2_bits);
-    if (is_kmer_present(next_3_bits))
-        upstream_kmers.push_back(next_3_bits);
-    if (is_kmer_present(next_4_bits))
-        upstream_kmers.push_back(next_4_bits);
 
-    return upstream_kmers;
+std::vector<uint32_t> Kmers::extend_path(uint32_t kmer, bool downstream, std::unordered_map<uint32_t, bool> & used) {
+    std::vector<uint32_t> extension;
+    while (true) {
+        Neighbours neighbours = downstream ? get_downstream_kmers(kmer) : get_upstream_kmers(kmer);
+        uint32_t best = 0;
+        int best_depth = -1;
+        for (auto neighbour : neighbours) {
+            if (!used[get_key(neighbour)] && get_depth(neighbour) > best_depth && is_offset_consistent(kmer, neighbour)) {
+                best = neighbour;
+                best_depth = get_depth(neighbour);
+            }
+        }
+        if (best_depth < 0)
+            return extension;
+        used[get_key(best)] = true;
+        extension.push_back(best);
+        kmer = best;
+    }
+}
+
+
+// When offsets are known, a path only continues to a neighbour whose mean offset is about one base on from the
+// current k-mer's, so the path doesn't run from the adapter into genomic k-mers which happen to overlap it.
+bool Kmers::is_offset_consistent(uint32_t kmer, uint32_t neighbour) const {
+    auto kmer_stats = m_positions.find(get_key(kmer));
+    auto neighbour_stats = m_positions.find(get_key(neighbour));
+    if (kmer_stats == m_positions.end() || neighbour_stats == m_positions.end())
+        return true;
+    double difference = std::abs(neighbour_stats->second.mean - kmer_stats->second.mean);
+    return difference <= 1.0 + MAX_OFFSET_SHIFT;
+}
+
+
+void Kmers::output_adapters_fasta(std::ostream & out) {
+    std::vector<AdapterPath> adapters = get_adapter_paths();
+    for (size_t i = 0; i < adapters.size(); ++i) {
+        const AdapterPath & adapter = adapters[i];
+        out << ">adapter_" << i + 1 << " length=" << adapter.sequence.size()
+            << " mean_depth=" << std::fixed << std::setprecision(1) << adapter.mean_depth
+            << " start_confidence=" << std::setprecision(3) << adapter.start_confidence
+            << " end_confidence=" << adapter.end_confidence;
+        if (adapter.offset >= 0.0)
+            out << " offset=" << std::setprecision(1) << adapter.offset;
+        out << " depths=";
+        for (size_t j = 0; j < adapter.depths.size(); ++j)
+            out << (j > 0 ? "," : "") << adapter.depths[j];
+        out << "\n" << adapter.sequence << "\n";
+    }
 }
 
 
-std::vector<uint32_t> Kmers::get_downstream_kmers(uint32_t kmer) {
-    std::string kmer_string = bits_to_kmer(kmer);
-    kmer_string.erase(0, 1);
+// The k-mers are oriented: each is linked as its canonical node, on the '-' strand if it is the reverse complement
+// of that node. In canonical mode, every link would be found from both of its nodes (as A+ -> B+ and B- -> A-), so
+// only the first of each pair is kept: this returns false for the second.
+bool Kmers::get_link(uint32_t kmer_1, uint32_t kmer_2, GraphLink & link) const {
+    uint32_t node_1 = get_key(kmer_1), node_2 = get_key(kmer_2);
+    bool forward_1 = (node_1 == kmer_1), forward_2 = (node_2 == kmer_2);
+    if (m_canonical && std::make_pair(node_1, forward_1) > std::make_pair(node_2, !forward_2))
+        return false;
+    link = {node_1, forward_1, node_2, forward_2};
+    return true;
+}
 
-    std::string next_1 = kmer_string + 'A';
-    std::string next_2 = kmer_string + 'C';
-    std::string next_3 = kmer_string + 'G';
-    std::string next_4 = kmer_string + 'T';
 
-    uint32_t next_1_bits = kmer_to_bits(next_1);
-    uint32_t next_2_bits = kmer_to_bits(next_2);
-    uint32_t next_3_bits = kmer_to_bits(next_3);
-    uint32_t next_4_bits = kmer_to_bits(next_4);
+// Complements every base (A=0 <-> T=3, C=1 <-> G=2 is a bitwise NOT), then reverses the order of the 2-bit bases by
+// swapping progressively larger blocks.
+uint32_t Kmers::reverse_complement(uint32_t kmer) const {
+    uint32_t x = ~kmer;
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+    x = (x >> 16) | (x << 16);
+    return x >> (32 - 2 * m_kmer_size);
+}
 
-    std::vector<uint32_t> downstream_kmers;
 
-    if (is_kmer_present(next_1_bits))
-        downstream_kmers.push_back(next_1_bits);
-    if (is_kmer_present(next_2_bits))
-        downstream_kmers.push_back(next_2_bits);
-    if (is_kmer_present(next_3_bits))
-        downstream_kmers.push_back(next_3_bits);
-    if (is_kmer_present(next_4_bits))
-        downstream_kmers.push_back(next_4_bits);
+// Neighbours are found by shifting the packed k-mer and adding each possible base at the open end, in A, C, G, T
+// order.
+Neighbours Kmers::get_upstream_kmers(uint32_t kmer) const {
+    Neighbours upstream_kmers;
+    uint32_t shifted = kmer >> 2;
+    for (uint32_t base = 0; base < 4; ++base) {
+        uint32_t upstream = shifted | (base << (2 * (m_kmer_size - 1)));
+        if (is_kmer_present(upstream))
+            upstream_kmers.push_back(upstream);
+    }
+    return upstream_kmers;
+}
 
+
+Neighbours Kmers::get_downstream_kmers(uint32_t kmer) const {
+    Neighbours downstream_kmers;
+    uint32_t shifted = (kmer << 2) & m_kmer_mask;
+    for (uint32_t base = 0; base < 4; ++base) {
+        uint32_t downstream = shifted | base;
+        if (is_kmer_present(downstream))
+            downstream_kmers.push_back(downstream);
+    }
     return downstream_kmers;
 }
 
 
+int Kmers::get_depth(uint32_t kmer) const {
+    if (m_frozen)
+        return m_frozen_kmers.get_depth(get_key(kmer));
+    auto found = m_kmers.find(get_key(kmer));
+    return (found == m_kmers.end()) ? 0 : found->second;
+}
+
+
 int Kmers::get_max_depth() {
     int max_depth = 0;
+    if (m_frozen) {
+        for (size_t i = 0; i < m_frozen_kmers.get_record_count(); ++i) {
+            if (!m_frozen_kmers.is_removed(i))
+                max_depth = std::max(max_depth, m_frozen_kmers.get_record(i).depth);
+        }
+        return max_depth;
+    }
     for (auto kv : m_kmers)
         max_depth = std::max(max_depth, kv.second);
     return max_depth;
 }
 
 
-void Kmers::remove_tips() {
-    std::vector<uint32_t> kmers_to_remove;
-    for (auto kv : m_kmers) {
-        uint32_t kmer = kv.first;
-        int count = kv.second;
-
-        std::vector<uint32_t> upstream = get_upstream_kmers(kmer);
-        std::vector<uint32_t> downstream = get_downstream_kmers(kmer);
-
-        if (downstream.empty()) {
-            int max_upstream_count = 0;
-            for (auto upstream_kmer : upstream)
-                max_upstream_count = std::max(max_upstream_count, m_kmers[upstream_kmer]);
-            if (max_upstream_count > count * 2)
-                kmers_to_remove.push_back(kmer);
-        }
+// Tips are removed using a worklist: every dead end starts on it, and when a tip is removed, the k-mers it was
+// attached to go on it, as they may now be tips themselves. This continues until no more tips can be removed. The
+// initial dead ends are found in parallel, but the worklist is processed on one thread, in k-mer order.
+// The table only shrinks here, so whether a k-mer is on the worklist is kept in a flag per k-mer of the sorted
+// snapshot taken at the start.
+void Kmers::remove_tips(int max_tip_length) {
+    std::vector<uint32_t> & kmers = m_scratch.sorted_kmers;
+    std::vector<char> & in_worklist = m_scratch.queued;
+    std::vector<uint32_t> & worklist = m_scratch.worklist;
+    sort_kmers(kmers);
+    in_worklist.assign(kmers.size(), 0);
+    parallel_for(kmers.size(), [&](size_t i) {
+        in_worklist[i] = get_upstream_kmers(kmers[i]).empty() != get_downstream_kmers(kmers[i]).empty();
+    });
+    worklist.clear();
+    for (size_t i = kmers.size(); i > 0; --i) {
+        if (in_worklist[i - 1])
+            worklist.push_back(kmers[i - 1]);
+    }
 
-        else if (upstream.empty()) {
-            int max_downstream_count = 0;
-            for (auto downstream_kmer : downstream)
-                max_downstream_count = std::max(max_downstream_count, m_kmers[downstream_kmer]);
-            if (max_downstream_count > count * 2)
-                kmers_to_remove.push_back(kmer);
+    while (!worklist.empty()) {
+        uint32_t kmer = worklist.back();
+        worklist.pop_back();
+        in_worklist[get_sorted_index(kmer)] = 0;
+        if (!is_kmer_present(kmer))
+            continue;
+
+        Neighbours upstream = get_upstream_kmers(kmer);
+        Neighbours downstream = get_downstream_kmers(kmer);
+        Neighbours anchors;
+        if (downstream.empty() && !upstream.empty())
+            anchors = clip_tip(kmer, true, max_tip_length);
+        else if (upstream.empty() && !downstream.empty())
+            anchors = clip_tip(kmer, false, max_tip_length);
+
+        for (auto anchor : anchors) {
+            size_t index = get_sorted_index(get_key(anchor));
+            if (!in_worklist[index]) {
+                in_worklist[index] = 1;
+                worklist.push_back(get_key(anchor));
+            }
         }
     }
-
-    for (auto kmer : kmers_to_remove)
-        m_kmers.erase(kmer);
 }
 
 
-void Kmers::remove_large_diff() {
-    std::vector<uint32_t> kmers_to_remove;
-    for (auto kv : m_kmers) {
-        uint32_t kmer = kv.first;
-        int count = kv.second;
+// Follows a tip back from its dead end, one k-mer at a time, for up to max_tip_length k-mers. The tip is removed if
+// the k-mers it attaches to are more than twice as deep as the deepest k-mer in the tip. The walk stops at a
+// junction, since anything beyond it is not part of the tip. Returns the k-mers the removed tip was attached to.
+Neighbours Kmers::clip_tip(uint32_t dead_end, bool dead_end_downstream, int max_tip_length) {
+    std::vector<uint32_t> & tip = m_scratch.tip;
+    tip.assign(1, dead_end);
+    int max_tip_count = get_depth(dead_end);
+    uint32_t kmer = dead_end;
+    while (true) {
+        Neighbours anchors = dead_end_downstream ? get_upstream_kmers(kmer) : get_downstream_kmers(kmer);
+        if (anchors.empty())
+            return Neighbours();
+
+        int max_anchor_count = 0;
+        for (auto anchor : anchors)
+            max_anchor_count = std::max(max_anchor_count, get_depth(anchor));
+        if (max_anchor_count > max_tip_count * 2) {
+            for (auto tip_kmer : tip)
+                erase_kmer(get_key(tip_kmer));
+            return anchors;
+        }
 
-        std::vector<uint32_t> neighbours = get_upstream_kmers(kmer);
-        std::vector<uint32_t> downstream = get_downstream_kmers(kmer);
-        neighbours.insert(neighbours.end(), downstream.begin(), downstream.end());
+        if (anchors.size() != 1 || int(tip.size()) >= max_tip_length)
+            return Neighbours();
+        uint32_t next = anchors[0];
+        Neighbours next_branches = dead_end_downstream ? get_downstream_kmers(next) : get_upstream_kmers(next);
+        if (next_branches.size() != 1)
+            return Neighbours();
 
-        int max_neighbour_count = 0;
-        for (auto neighbour : neighbours)
-            max_neighbour_count = std::max(max_neighbour_count, m_kmers[neighbour]);
-        if (max_neighbour_count > count * 5)
-            kmers_to_remove.push_back(kmer);
+        tip.push_back(next);
+        max_tip_count = std::max(max_tip_count, get_depth(next));
+        kmer = next;
     }
+}
 
-    for (auto kmer : kmers_to_remove)
-        m_kmers.erase(kmer);
+
+// A sequencing error in a read makes a bubble: an alternative path of about k k-mers which leaves the true path at
+// one k-mer and rejoins it at another. For each k-mer with more than one downstream k-mer, this follows each branch
+// through non-branching k-mers to where it rejoins. If the rejoining k-mer can also be reached by a short search
+// through the other branches, the branch is a bubble, and it is removed if its mean depth is less than half the
+// depth of the k-mers at both of its ends.
+void Kmers::pop_bubbles(int max_bubble_length) {
+    sort_kmers(m_scratch.sorted_kmers);
+    for (auto kmer : m_scratch.sorted_kmers) {
+        if (!is_kmer_present(kmer))
+            continue;
+        pop_bubbles_from(kmer, max_bubble_length);
+        if (m_canonical && reverse_complement(kmer) != kmer && is_kmer_present(kmer))
+            pop_bubbles_from(reverse_complement(kmer), max_bubble_length);
+    }
 }
 
 
-void Kmers::remove_singletons() {
-    std::vector<uint32_t> kmers_to_remove;
-    for (auto kv : m_kmers) {
-        uint32_t kmer = kv.first;
+// Checks the branches downstream of one oriented k-mer. In canonical mode, a node's branches on its '-' strand are
+// found from its reverse complement.
+void Kmers::pop_bubbles_from(uint32_t kmer, int max_bubble_length) {
+    BubbleBranch & branch = m_scratch.branch;
+    Neighbours downstream = get_downstream_kmers(kmer);
+    if (downstream.size() < 2)
+        return;
+
+    for (auto next : downstream) {
+        if (!follow_bubble_branch(kmer, next, max_bubble_length, branch) || branch.kmers.empty())
+            continue;
+        double end_depth = std::min(get_depth(kmer), get_depth(branch.end));
+        if (branch.mean_depth * 2.0 >= end_depth)
+            continue;
+        if (is_reachable_without(kmer, branch.end, next, max_bubble_length + 1)) {
+            for (auto branch_kmer : branch.kmers)
+                erase_kmer(get_key(branch_kmer));
+        }
+    }
+}
 
-        std::vector<uint32_t> neighbours = get_upstream_kmers(kmer);
-        std::vector<uint32_t> downstream = get_downstream_kmers(kmer);
-        neighbours.insert(neighbours.end(), downstream.begin(), downstream.end());
 
-        int num_neighbours = 0;
-        for (auto neighbour : neighbours) {
-            if (neighbour != kmer)
-                num_neighbours += 1;
+// Follows one branch of a possible bubble, starting at first (just downstream of start), until it reaches a k-mer
+// with more than one upstream k-mer. Returns false if the branch splits, dead-ends or is too long before then.
+bool Kmers::follow_bubble_branch(uint32_t start, uint32_t first, int max_bubble_length, BubbleBranch & branch) {
+    branch.kmers.clear();
+    long long total_depth = 0;
+    uint32_t kmer = first;
+    while (get_upstream_kmers(kmer).size() == 1) {
+        if (int(branch.kmers.size()) >= max_bubble_length || kmer == start)
+            return false;
+        branch.kmers.push_back(kmer);
+        total_depth += get_depth(kmer);
+        Neighbours downstream = get_downstream_kmers(kmer);
+        if (downstream.size() != 1)
+            return false;
+        kmer = downstream[0];
+    }
+    branch.end = kmer;
+    branch.mean_depth = branch.kmers.empty() ? 0.0 : double(total_depth) / branch.kmers.size();
+    return true;
+}
+
+
+// Breadth-first search downstream from start (not going through excluded) for up to max_steps steps. Only k-mers in
+// the table can be visited, so the visited set never needs more room than the table has k-mers.
+bool Kmers::is_reachable_without(uint32_t start, uint32_t target, uint32_t excluded, int max_steps) {
+    std::vector<uint32_t> & frontier = m_scratch.frontier;
+    std::vector<uint32_t> & next_frontier = m_scratch.next_frontier;
+    ReadKmerSet & visited = m_scratch.visited;
+    frontier.assign(1, start);
+    visited.start_read(get_kmer_count() + 2);
+    visited.insert(start);
+    visited.insert(excluded);
+    for (int step = 0; step < max_steps && !frontier.empty(); ++step) {
+        next_frontier.clear();
+        for (auto kmer : frontier) {
+            for (auto next : get_downstream_kmers(kmer)) {
+                if (next == target)
+                    return true;
+                if (visited.insert(next))
+                    next_frontier.push_back(next);
+            }
         }
-        if (num_neighbours == 0)
-            kmers_to_remove.push_back(kmer);
+        frontier.swap(next_frontier);
     }
+    return false;
+}
 
-    for (auto kmer : kmers_to_remove)
-        m_kmers.erase(kmer);
+
+// Genomic k-mers turn up at any offset in the margin, so their offsets are spread out, with a standard deviation of
+// about margin / sqrt(12). Adapter k-mers turn up at nearly the same offset in every read. K-mers with offsets spread
+// more than half as much as random ones are removed.
+void Kmers::remove_positional_outliers() {
+    double max_sd = 0.5 * m_margin / std::sqrt(12.0);
+    remove_marked_kmers([this, max_sd](uint32_t kmer, int) {
+        return get_offset_sd(kmer) > max_sd;
+    });
+}
+
+
+void Kmers::remove_large_diff() {
+    remove_marked_kmers([this](uint32_t kmer, int count) {
+        int max_neighbour_count = 0;
+        for (auto neighbour : get_upstream_kmers(kmer))
+            max_neighbour_count = std::max(max_neighbour_count, get_depth(neighbour));
+        for (auto neighbour : get_downstream_kmers(kmer))
+            max_neighbour_count = std::max(max_neighbour_count, get_depth(neighbour));
+        return max_neighbour_count > count * 5;
+    });
+}
+
+
+void Kmers::remove_singletons() {
+    remove_marked_kmers([this](uint32_t kmer, int) {
+        int num_neighbours = 0;
+        for (auto neighbour : get_upstream_kmers(kmer))
+            num_neighbours += (get_key(neighbour) != kmer);
+        for (auto neighbour : get_downstream_kmers(kmer))
+            num_neighbours += (get_key(neighbour) != kmer);
+        return num_neighbours == 0;
+    });
 }
@@ -18,8 +18,164 @@
 
 
 #include <string>
+#include <ostream>
+#include <streambuf>
 #include <vector>
 #include <unordered_map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+#include "count_file.h"
+#include "disk_partitions.h"
+#include "frozen_kmers.h"
+#include "progress.h"
+
+
+class BarcodeClassifier;
+
+
+struct CleaningStep
+{
+    std::string name;
+    int remaining_kmers;
+};
+
+
+struct BubbleBranch
+{
+    std::vector<uint32_t> kmers;
+    uint32_t end;
+    double mean_depth;
+};
+
+
+// An adapter sequence extracted from the cleaned graph. The depths are for each k-mer along the path, and the offset
+// is the first k-mer's mean offset from the read end (-1 if unknown). The confidences are the depth at each end
+// relative to the deepest k-mer on the path: an end which fades out (as the less clear end of an adapter does) gets
+// a low confidence.
+struct AdapterPath
+{
+    std::string sequence;
+    std::vector<int> depths;
+    double mean_depth;
+    double offset;
+    double start_confidence;
+    double end_confidence;
+};
+
+
+struct PositionStats
+{
+    float mean;
+    float m2;
+};
+
+
+// The k-mers next to a k-mer in the graph. There can be at most four, so they are held in a fixed array instead of
+// a vector, and looking at a k-mer's neighbours doesn't allocate.
+struct Neighbours
+{
+    Neighbours() : count(0) {}
+    void push_back(uint32_t kmer) {kmers[count++] = kmer;}
+    bool empty() const {return count == 0;}
+    size_t size() const {return size_t(count);}
+    uint32_t operator[](size_t i) const {return kmers[i];}
+    const uint32_t * begin() const {return kmers;}
+    const uint32_t * end() const {return kmers + count;}
+
+    uint32_t kmers[4];
+    int count;
+};
+
+
+// The set of k-mers seen so far in one read, used to count each k-mer at most once per read. Slots are stamped with
+// a generation number, so emptying the set between reads is just a matter of starting a new generation.
+class ReadKmerSet
+{
+public:
+    ReadKmerSet() : m_generation(0), m_mask(0) {}
+    void start_read(int max_kmers);
+    bool insert(uint32_t kmer);
+
+private:
+    std::vector<uint32_t> m_kmers;
+    std::vector<uint32_t> m_stamps;
+    uint32_t m_generation;
+    uint32_t m_mask;
+};
+
+
+// Working space for the cleaning passes. It belongs to the table and is reused by every pass, so once its vectors
+// have grown to fit the graph, cleaning doesn't allocate per k-mer. The sorted k-mers are a snapshot of the table's
+// keys, and the flags and queued markers are indexed in the same order.
+struct CleaningScratch
+{
+    std::vector<std::pair<uint32_t, int>> entries;
+    std::vector<uint32_t> sorted_kmers;
+    std::vector<char> flags;
+    std::vector<char> queued;
+    std::vector<uint32_t> worklist;
+    std::vector<uint32_t> tip;
+    std::vector<uint32_t> frontier;
+    std::vector<uint32_t> next_frontier;
+    ReadKmerSet visited;
+    BubbleBranch branch;
+};
+
+
+// A segment is one k-mer node. Links are between oriented k-mers: a node used on its '-' strand stands for its
+// reverse complement (only in canonical mode).
+struct GraphSegment
+{
+    uint32_t kmer;
+    std::string sequence;
+    int depth;
+};
+
+
+struct GraphLink
+{
+    uint32_t from;
+    bool from_forward;
+    uint32_t to;
+    bool to_forward;
+};
+
+
+struct AdapterGraph
+{
+    int kmer_size;
+    std::vector<GraphSegment> segments;
+    std::vector<GraphLink> links;
+};
+
+
+typedef std::function<void(const std::string &)> LogCallback;
+
+
+// A stream buffer which discards everything written to it.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) {return c;}
+};
+
+
+// A stream buffer which passes each line written to it to a callback. Carriage returns (used for progress updates)
+// end a line too.
+class CallbackBuffer : public std::streambuf
+{
+public:
+    CallbackBuffer(LogCallback callback) : m_callback(callback) {}
+
+protected:
+    int overflow(int c);
+
+private:
+    LogCallback m_callback;
+    std::string m_line;
+};
 
 
 class Kmers
@@ -27,35 +183,150 @@ class Kmers
 public:
     Kmers(int kmer_size);
 
-    int get_kmer_count() {return int(m_kmers.size());}
+    int get_kmer_size() {return int(m_kmer_size);}
+    int get_kmer_count() {return int(m_frozen ? m_frozen_kmers.size() : m_kmers.size());}
     int get_max_depth();
+    long long get_read_count() {return m_read_count;}
+    bool get_start() {return m_start;}
+    bool get_end() {return m_end;}
+    bool get_canonical() {return m_canonical;}
+    int get_margin() {return m_margin;}
+
+    void set_threads(int threads) {m_threads = threads;}
+    void set_positional(bool positional) {m_positional = positional;}
+    void set_distinct(bool distinct) {m_distinct = distinct;}
+    void set_canonical(bool canonical) {m_canonical = canonical;}
+    void set_quiet(bool quiet) {m_quiet = quiet;}
+    void set_log_callback(LogCallback callback);
+    void set_progress(ProgressReporter * progress);
+    void set_read_limit(long long max_reads, double sample_fraction);
+    void set_convergence(double filter_depth, double tolerance);
 
-    void add_fastq(std::string filename, bool start, int margin);
+    bool set_disk_counting(std::string temp_dir, long long max_memory);
+    bool count_disk_partitions(double filter_fraction);
+
+    void clear();
+    Kmers get_filtered_copy(int min_depth);
+    Kmers get_frozen_copy();
+
+    bool set_barcodes(std::string filename);
+    int get_cluster_count() {return int(m_clusters.size());}
+    std::string get_cluster_name(int cluster);
+    Kmers & get_cluster(int cluster) {return *m_clusters[cluster];}
+
+    bool add_fastq(std::string filename, bool start, bool end, int margin);
+    void add_read(const char * sequence, int length, bool start, bool end, int margin);
+    bool save_counts(std::string filename);
+    bool save_sharded_counts(std::string prefix, int shard_count);
+    bool load_counts(std::string filename, int min_depth = 0);
+
+    std::vector<CleaningStep> clean(int filter_depth, int max_tip_length);
     void remove_low_depth_kmers(int min_depth);
-    void remove_tips();
+    void remove_tips(int max_tip_length);
+    void pop_bubbles(int max_bubble_length);
+    void remove_positional_outliers();
     void remove_large_diff();
     void remove_singletons();
-    void output_gfa();
-    bool is_kmer_present(uint32_t kmer);
+    AdapterGraph get_graph();
+    void output_gfa(std::ostream & out);
+    std::vector<AdapterPath> get_adapter_paths();
+    std::vector<uint32_t> get_oriented_kmers();
+    void output_adapters_fasta(std::ostream & out);
+    bool is_kmer_present(uint32_t kmer) const;
+    int get_depth(uint32_t kmer) const;
+    double get_offset_sd(uint32_t kmer) const;
 
-    uint32_t kmer_to_bits(char * sequence);
+    uint32_t kmer_to_bits(const char * sequence);
     uint32_t kmer_to_bits(std::string sequence);
-    uint32_t base_to_bits(char base);
+    static uint32_t base_to_bits(char base);
+
+    uint32_t reverse_complement(uint32_t kmer) const;
+
+    // In canonical mode, a k-mer and its reverse complement share one entry, stored under whichever is smaller.
+    uint32_t get_key(uint32_t kmer) const {return m_canonical ? std::min(kmer, reverse_complement(kmer)) : kmer;}
 
     std::string bits_to_kmer(uint32_t kmer);
-    char bits_to_base(uint32_t kmer);
+    static char bits_to_base(uint32_t kmer);
 
 private:
     size_t m_kmer_size;
+    uint32_t m_kmer_mask;
+    int m_threads;
+    bool m_quiet;
+    std::shared_ptr<CallbackBuffer> m_log_buffer;
+    std::shared_ptr<std::ostream> m_log_stream;
+    ProgressReporter * m_progress;
+    ProgressCounters * m_progress_counters;
+
+    bool m_positional;
+    bool m_distinct;
+    ReadKmerSet m_read_kmers;
+    std::unordered_map<uint32_t, PositionStats> m_positions;
     std::unordered_map<uint32_t, int> m_kmers;
+    std::shared_ptr<DiskPartitions> m_disk;
+
+    // Cleaning starts by removing low-depth k-mers, and the rest are then moved out of the hash map into a frozen
+    // table, which is what all later cleaning and output use. A frozen table can't be counted into until clear().
+    FrozenKmers m_frozen_kmers;
+    bool m_frozen;
+    CleaningScratch m_scratch;
+
+    // With seed barcodes, each read is counted in the table for its barcode, with unclassified reads in the last one,
+    // and this table stays empty.
+    std::shared_ptr<BarcodeClassifier> m_barcodes;
+    std::vector<std::shared_ptr<Kmers>> m_clusters;
+
+    bool m_start;
+    bool m_end;
+    bool m_canonical;
+    int m_margin;
+    bool m_mode_set;
+    int m_count_files_loaded;
+    uint32_t m_shard_index;
+    uint32_t m_shard_count;
+    std::unordered_map<uint32_t, long long> m_shard_read_counts;
+
+    long long m_read_count;
+    long long m_max_reads;
+    double m_sample_fraction;
+
+    bool m_converge;
+    double m_converge_filter_depth;
+    double m_converge_tolerance;
+    int m_stable_batches;
+    std::unordered_map<uint32_t, double> m_last_profile;
+
+    std::ostream & log();
+    Kmers get_bare_copy();
+    bool is_read_sampled(const char * name);
+    bool has_converged();
+
+    Neighbours get_upstream_kmers(uint32_t kmer) const;
+    Neighbours get_downstream_kmers(uint32_t kmer) const;
+    void sort_kmers(std::vector<uint32_t> & kmers) const;
+    size_t get_sorted_index(uint32_t kmer) const;
+    void remove_marked_kmers(std::function<bool(uint32_t, int)> should_remove);
+    void freeze();
+    void erase_kmer(uint32_t kmer);
+    void get_entries(std::vector<std::pair<uint32_t, int>> & entries) const;
+    void parallel_for(size_t count, std::function<void(size_t)> function);
+    void pop_bubbles_from(uint32_t kmer, int max_bubble_length);
+    bool follow_bubble_branch(uint32_t start, uint32_t first, int max_bubble_length, BubbleBranch & branch);
+    bool is_reachable_without(uint32_t start, uint32_t target, uint32_t excluded, int max_steps);
+    Neighbours clip_tip(uint32_t dead_end, bool dead_end_downstream, int max_tip_length);
 
-    std::vector<uint32_t> get_upstream_kmers(uint32_t kmer);
-    std::vector<uint32_t> get_downstream_kmers(uint32_t kmer);
+    std::vector<uint32_t> extend_path(uint32_t kmer, bool downstream, std::unordered_map<uint32_t, bool> & used);
 
-    void print_segment_line(uint32_t kmer);
-    void print_link_line(uint32_t kmer_1, uint32_t kmer_2);
+    bool get_link(uint32_t kmer_1, uint32_t kmer_2, GraphLink & link) const;
 
+    void add_barcoded_read(const char * sequence, int length, bool start, bool end, int margin);
+    void add_read_range(const char * sequence, int length, int range_start, int range_end, bool start);
     void add_kmer(uint32_t kmer);
+    void add_position(uint32_t kmer, int offset);
+    bool is_offset_consistent(uint32_t kmer, uint32_t neighbour) const;
+    void add_count(uint32_t kmer, uint32_t count);
+    CountFileHeader get_count_file_header();
+    long long get_most_shard_reads();
 };
 
 
@@ -0,0 +1,184 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "known_adapters.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <climits>
+
+#include "kmer_set.h"
+
+
+// Known adapters with less than this fraction of their k-mers in the graph aren't aligned, and matches with less than
+// this identity aren't reported.
+#define MIN_CONTAINMENT 0.3
+#define MIN_IDENTITY 0.7
+
+// Alignments are limited to this many bases either side of the diagonal given by the shared k-mers.
+#define ALIGNMENT_BAND 8
+
+
+static std::string reverse_complement(const std::string & sequence);
+static double get_containment(Kmers & kmers, const KmerSet & graph_kmers, const std::string & sequence);
+static double get_best_identity(Kmers & kmers, const std::string & adapter, const std::vector<AdapterPath> & paths);
+static bool get_main_diagonal(Kmers & kmers, const std::string & query, const std::string & target, int & diagonal);
+static int banded_edit_distance(const std::string & query, const std::string & target, int diagonal, int band);
+
+
+// Oxford Nanopore adapters and native barcodes (BC01 to BC12, with their flanking sequence), as used by Porechop.
+std::vector<KnownAdapter> get_known_adapters() {
+    std::vector<KnownAdapter> adapters = {
+        {"SQK-NSK007", "start", "AATGTACTTCGTTCAGTTACGTATTGCT"},
+        {"SQK-NSK007", "end", "GCAATACGTAACTGAACGAAGT"},
+        {"SQK-RAD", "start", "TTTTTTTTCCTGTACTTCGTTCAGTTACGTATTGCT"},
+        {"SQK-RBK004", "upstream", "AATGTACTTCGTTCAGTTACGGCTTGGGTGTTTAACC"},
+        {"SQK-MAP006", "start", "GGTTGTTTCTGTTGGTGCTGATATTGCT"},
+        {"SQK-MAP006", "end", "GCAATATCAGCACCAACAGAAA"},
+        {"SQK-MAP006 short", "start", "CGGCGTCTGCTTGGGTGTTTAACCT"},
+        {"SQK-MAP006 short", "end", "AGGTTAAACACCCAAGCAGACGCCG"},
+        {"PCR adapters 1", "start", "ACTTGCCTGTCGCTCTATCTTC"},
+        {"PCR adapters 1", "end", "GAAGATAGAGCGACAGGCAAGT"},
+        {"PCR tail 1", "start", "TTAACCTTTCTGTTGGTGCTGATATTGC"},
+        {"PCR tail 1", "end", "GCAATATCAGCACCAACAGAAAGGTTAA"},
+        {"PCR tail 2", "start", "TTAACCTACTTGCCTGTCGCTCTATCTTC"},
+        {"PCR tail 2", "end", "GAAGATAGAGCGACAGGCAAGTAGGTTAA"}
+    };
+    std::vector<std::pair<std::string, std::string>> barcodes = {
+        {"BC01", "AAGAAAGTTGTCGGTGTCTTTGTG"}, {"BC02", "TCGATTCCGTTTGTAGTCGTCTGT"},
+        {"BC03", "GAGTCTTGTGTCCCAGTTACCAGG"}, {"BC04", "TTCGGATTCTATCGTGTTTCCCTA"},
+        {"BC05", "CTTGTCCAGGGTTTGTGTAACCTT"}, {"BC06", "TTCTCGCAAAGGCAGAAAGTAGTC"},
+        {"BC07", "GTGTTACCGTGGGAATGAATCCTT"}, {"BC08", "TTCAGGGAACAAACCAAGTTACGT"},
+        {"BC09", "AACTAGGCACAGCGAGTCTTGGTT"}, {"BC10", "AAGCGTTGAAACCTTTGTCCTCTC"},
+        {"BC11", "GTTTCATCTATCGGAGGGAATGGA"}, {"BC12", "CAGGTAGAAAGAAGCAGAATCGGA"}
+    };
+    // The barcodes are listed as sequenced at the read start, but the flanks are from the other strand, so the barcode
+    // is reverse complemented between them.
+    for (auto barcode : barcodes)
+        adapters.push_back({"Native barcoding", barcode.first,
+                            "AAGGTTAA" + reverse_complement(barcode.second) + "CAGCACCT"});
+    return adapters;
+}
+
+
+// Known adapters are screened by k-mer containment, which is cheap, and only those which pass are aligned to the
+// assembled paths. Matches are sorted best first.
+std::vector<AdapterMatch> match_known_adapters(Kmers & kmers, const std::vector<AdapterPath> & paths) {
+    KmerSet graph_kmers(kmers.get_oriented_kmers());
+    std::vector<AdapterMatch> matches;
+    for (auto adapter : get_known_adapters()) {
+        double containment = get_containment(kmers, graph_kmers, adapter.sequence);
+        if (containment < MIN_CONTAINMENT)
+            continue;
+        double identity = get_best_identity(kmers, adapter.sequence, paths);
+        if (identity >= MIN_IDENTITY)
+            matches.push_back({adapter.kit, adapter.name, containment, identity});
+    }
+    std::stable_sort(matches.begin(), matches.end(), [](const AdapterMatch & a, const AdapterMatch & b) {
+        if (a.identity != b.identity)
+            return a.identity > b.identity;
+        return a.containment > b.containment;
+    });
+    return matches;
+}
+
+
+static std::string reverse_complement(const std::string & sequence) {
+    std::string complement(sequence.rbegin(), sequence.rend());
+    for (auto & base : complement)
+        base = Kmers::bits_to_base(3 - Kmers::base_to_bits(base));
+    return complement;
+}
+
+
+static double get_containment(Kmers & kmers, const KmerSet & graph_kmers, const std::string & sequence) {
+    int kmer_count = int(sequence.size()) - kmers.get_kmer_size() + 1;
+    if (kmer_count <= 0)
+        return 0.0;
+    int found = 0;
+    for (int i = 0; i < kmer_count; ++i) {
+        uint32_t kmer = kmers.kmer_to_bits(sequence.substr(size_t(i), size_t(kmers.get_kmer_size())));
+        if (graph_kmers.contains(kmer) || graph_kmers.contains(kmers.reverse_complement(kmer)))
+            ++found;
+    }
+    return double(found) / kmer_count;
+}
+
+
+// The adapter is aligned in full to any part of each path, in both orientations.
+static double get_best_identity(Kmers & kmers, const std::string & adapter, const std::vector<AdapterPath> & paths) {
+    double best = 0.0;
+    for (auto path : paths) {
+        for (auto target : {path.sequence, reverse_complement(path.sequence)}) {
+            int diagonal;
+            if (!get_main_diagonal(kmers, adapter, target, diagonal))
+                continue;
+            int distance = banded_edit_distance(adapter, target, diagonal, ALIGNMENT_BAND);
+            best = std::max(best, 1.0 - double(distance) / adapter.size());
+        }
+    }
+    return best;
+}
+
+
+// Finds the most common offset (target position minus query position) of the k-mers the sequences share. Returns
+// false if they share none.
+static bool get_main_diagonal(Kmers & kmers, const std::string & query, const std::string & target, int & diagonal) {
+    int kmer_size = kmers.get_kmer_size();
+    std::unordered_map<uint32_t, std::vector<int>> target_positions;
+    for (int j = 0; j + kmer_size <= int(target.size()); ++j)
+        target_positions[kmers.kmer_to_bits(target.substr(size_t(j), size_t(kmer_size)))].push_back(j);
+
+    std::unordered_map<int, int> diagonal_counts;
+    int best_count = 0;
+    for (int i = 0; i + kmer_size <= int(query.size()); ++i) {
+        auto found = target_positions.find(kmers.kmer_to_bits(query.substr(size_t(i), size_t(kmer_size))));
+        if (found == target_positions.end())
+            continue;
+        for (auto j : found->second) {
+            int count = ++diagonal_counts[j - i];
+            if (count > best_count) {
+                best_count = count;
+                diagonal = j - i;
+            }
+        }
+    }
+    return best_count > 0;
+}
+
+
+// The edit distance of the whole query to its best-matching part of the target, only filling cells within band of
+// the diagonal.
+static int banded_edit_distance(const std::string & query, const std::string & target, int diagonal, int band) {
+    int n = int(query.size()), m = int(target.size());
+    const int infinity = INT_MAX / 2;
+    std::vector<int> previous(size_t(m) + 1, 0), current(size_t(m) + 1, infinity);
+    for (int i = 1; i <= n; ++i) {
+        int first = std::max(1, i + diagonal - band), last = std::min(m, i + diagonal + band);
+        std::fill(current.begin(), current.end(), infinity);
+        if (i + diagonal - band <= 0)
+            current[0] = i;
+        for (int j = first; j <= last; ++j) {
+            int substitution = previous[size_t(j - 1)] + (query[size_t(i - 1)] != target[size_t(j - 1)]);
+            current[size_t(j)] = std::min({substitution, previous[size_t(j)] + 1, current[size_t(j - 1)] + 1});
+        }
+        std::swap(previous, current);
+    }
+    int best = n;
+    for (int j = 0; j <= m; ++j)
+        best = std::min(best, previous[size_t(j)]);
+    return best;
+}
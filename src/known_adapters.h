@@ -0,0 +1,50 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef KNOWN_ADAPTERS_H
+#define KNOWN_ADAPTERS_H
+
+
+#include <string>
+#include <vector>
+
+#include "kmers.h"
+
+
+struct KnownAdapter
+{
+    std::string kit;
+    std::string name;
+    std::string sequence;
+};
+
+
+// How well a known adapter matches the cleaned graph. Containment is the fraction of the known adapter's k-mers
+// (in either orientation) which are in the graph, and identity is from its best alignment to an assembled path.
+struct AdapterMatch
+{
+    std::string kit;
+    std::string name;
+    double containment;
+    double identity;
+};
+
+
+std::vector<KnownAdapter> get_known_adapters();
+
+std::vector<AdapterMatch> match_known_adapters(Kmers & kmers, const std::vector<AdapterPath> & paths);
+
+
+#endif // KNOWN_ADAPTERS_H
@@ -17,14 +17,72 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "arguments.h"
 #include "kmers.h"
 #include "misc.h"
+#include "count_file.h"
+#include "trimmer.h"
+#include "scanner.h"
+#include "known_adapters.h"
+#include "server.h"
+#include "progress.h"
 
 #define PROGRAM_VERSION "0.1.0"
 
 
+static void print_cleaning_table(std::ostream & out, const std::vector<CleaningStep> & steps, int kmer_size);
+static void print_known_adapter_matches(std::ostream & out, Kmers & kmers);
+static bool run_sweep(Kmers & kmers, int max_depth, int tip_length, Arguments & args);
+static bool run_batch(Arguments & args, ProgressReporter & progress);
+static bool run_barcode_clusters(Kmers & kmers, int tip_length, Arguments & args);
+static bool save_adapters(Kmers & kmers, std::string filename);
+static bool run_trim(Kmers & kmers, Arguments & args, ProgressReporter & progress);
+static bool run_scan(Kmers & kmers, Arguments & args, ProgressReporter & progress);
+static bool run_watch(Kmers & kmers, Arguments & args);
+
+
+static bool read_count_file_headers(std::vector<std::string> filenames, std::vector<CountFileHeader> & headers) {
+    for (auto filename : filenames) {
+        std::ifstream in(filename, std::ios::binary);
+        CountFileHeader header;
+        if (!read_count_file_header(in, filename, header))
+            return false;
+        headers.push_back(header);
+    }
+    return true;
+}
+
+
+// Returns true if the count files are all different shards of the same partitioning, in which case no k-mer is in
+// more than one of them.
+static bool are_disjoint_shards(const std::vector<CountFileHeader> & headers) {
+    std::vector<bool> seen(headers[0].shard_count, false);
+    for (auto header : headers) {
+        if (header.shard_count != headers[0].shard_count || header.shard_count == 1 || seen[header.shard_index])
+            return false;
+        seen[header.shard_index] = true;
+    }
+    return true;
+}
+
+
 int main(int argc, char **argv)
 {
     Arguments args(argc, argv);
@@ -38,38 +96,528 @@ int main(int argc, char **argv)
     }
 
     std::cerr << "\n";
+    ProgressReporter progress(std::cerr, isatty(STDERR_FILENO));
 
-    Kmers kmers(args.kmer);
-    for (auto read_file : args.input_reads)
-        kmers.add_fastq(read_file, args.start, args.margin);
+    if (!args.samples.empty())
+        return run_batch(args, progress) ? 0 : 1;
+
+    if (args.command == SERVE) {
+        AssemblerOptions defaults;
+        defaults.kmer = args.kmer;
+        defaults.filter_depth = args.filter_depth;
+        defaults.margin = args.margin;
+        defaults.start = args.start || !args.end;
+        defaults.end = args.end;
+        defaults.canonical = args.canonical;
+        defaults.distinct = args.distinct;
+        defaults.tip_length = args.tip_length;
+        return run_server(std::cin, std::cout, defaults, args.threads);
+    }
+
+    int kmer_size = args.kmer;
+    std::vector<CountFileHeader> headers;
+    if (!args.input_counts.empty()) {
+        if (!read_count_file_headers(args.input_counts, headers))
+            return 1;
+        kmer_size = int(headers[0].kmer_size);
+    }
+    Kmers kmers(kmer_size);
+    kmers.set_threads(args.threads);
+    kmers.set_positional(args.positional);
+    kmers.set_distinct(args.distinct);
+    kmers.set_canonical(args.canonical);
+    if (!args.barcodes.empty() && !kmers.set_barcodes(args.barcodes))
+        return 1;
+
+    double lowest_filter_depth = args.filter_depth;
+    if (!args.sweep.empty())
+        lowest_filter_depth = *std::min_element(args.sweep.begin(), args.sweep.end());
+
+    if (args.input_counts.empty()) {
+        kmers.set_read_limit(args.max_reads, args.sample_fraction);
+        if (args.converge)
+            kmers.set_convergence(args.filter_depth, args.converge_tolerance);
+        if (args.max_memory > 0 && !kmers.set_disk_counting(args.temp_dir, args.max_memory * 1000000LL))
+            return 1;
+        progress.start("hashing", args.input_reads);
+        kmers.set_progress(&progress);
+        for (auto read_file : args.input_reads) {
+            if (!kmers.add_fastq(read_file, args.start, args.end, args.margin))
+                break;
+        }
+        kmers.set_progress(NULL);
+        progress.finish();
+        if (args.max_memory > 0 && !kmers.count_disk_partitions(lowest_filter_depth))
+            return 1;
+    }
+    else {  // LOAD, MERGE, or TRIM/SCAN with --counts
+        for (auto header : headers) {
+            if (args.command == MERGE && (header.shard_index != headers[0].shard_index ||
+                                          header.shard_count != headers[0].shard_count)) {
+                std::cerr << "Error: merge requires all count files to be the same shard\n";
+                return 1;
+            }
+        }
+
+        // When loading every shard of a partitioned table, the max depth is known from the headers, so k-mers which
+        // won't pass the depth filter can be skipped as they are read.
+        int min_depth = 0;
+        if (args.command == LOAD && args.save_counts.empty() && are_disjoint_shards(headers)) {
+            if (int(headers.size()) < int(headers[0].shard_count))
+                std::cerr << "Warning: only " << headers.size() << " of " << headers[0].shard_count
+                          << " shards given\n\n";
+            uint32_t max_depth = 0;
+            for (auto header : headers)
+                max_depth = std::max(max_depth, header.max_depth);
+            min_depth = int(max_depth * lowest_filter_depth);
+        }
+
+        for (auto count_file : args.input_counts) {
+            if (!kmers.load_counts(count_file, min_depth))
+                return 1;
+        }
+    }
+
+    if (!args.watch_dir.empty())
+        return run_watch(kmers, args) ? 0 : 1;
+
+    if (!args.save_counts.empty() && args.shards > 1) {
+        if (!kmers.save_sharded_counts(args.save_counts, args.shards))
+            return 1;
+        std::cerr << "Saved " << int_to_string(kmers.get_kmer_count()) << " " << kmer_size << "-mer counts to "
+                  << args.save_counts << ".0 to " << args.save_counts << "." << args.shards - 1 << "\n\n";
+    }
+    else if (!args.save_counts.empty()) {
+        if (!kmers.save_counts(args.save_counts))
+            return 1;
+        std::cerr << "Saved " << int_to_string(kmers.get_kmer_count()) << " " << kmer_size << "-mer counts to "
+                  << args.save_counts << "\n\n";
+    }
+    if (args.command == MERGE)
+        return 0;
+
+    int tip_length = (args.tip_length > 0) ? args.tip_length : kmer_size;
+    if (!args.barcodes.empty())
+        return run_barcode_clusters(kmers, tip_length, args) ? 0 : 1;
 
     int max_depth = kmers.get_max_depth();
     std::cerr << "Maximum depth: " << max_depth << "\n";
+    if (!args.sweep.empty()) {
+        std::cerr << "\n";
+        return run_sweep(kmers, max_depth, tip_length, args) ? 0 : 1;
+    }
+
     auto filter_depth = int(max_depth * args.filter_depth);
     std::cerr << "Filter depth:  " << filter_depth << "\n\n";
 
+    print_cleaning_table(std::cerr, kmers.clean(filter_depth, tip_length), kmer_size);
+    std::cerr << "\n";
+    if (!args.no_known_adapters)
+        print_known_adapter_matches(std::cerr, kmers);
+    if (!args.adapters_out.empty() && !save_adapters(kmers, args.adapters_out))
+        return 1;
+    if (args.command == TRIM)
+        return run_trim(kmers, args, progress) ? 0 : 1;
+    if (args.command == SCAN)
+        return run_scan(kmers, args, progress) ? 0 : 1;
+    kmers.output_gfa(std::cout);
+    return 0;
+}
+
+
+static void print_cleaning_table(std::ostream & out, const std::vector<CleaningStep> & steps, int kmer_size) {
+    out << "Cleaning step                      Remaining " << kmer_size << "-mers\n";
+    out << "-------------------------------------------------------\n";
+    for (auto step : steps) {
+        std::string name = step.name;
+        name.resize(35, ' ');
+        out << name << int_to_string(step.remaining_kmers) << "\n";
+    }
+}
+
+
+static bool is_read_file(std::string filename) {
+    for (auto extension : {".fastq", ".fq", ".fasta", ".fa", ".fastq.gz", ".fq.gz", ".fasta.gz", ".fa.gz"}) {
+        std::string ending(extension);
+        if (filename.size() > ending.size() &&
+                filename.compare(filename.size() - ending.size(), ending.size(), ending) == 0)
+            return true;
+    }
+    return false;
+}
 
-    std::cerr << "Cleaning step                      Remaining " << args.kmer << "-mers\n";
-    std::cerr << "-------------------------------------------------------\n";
 
-    std::cerr << "remove low-depth nodes             ";
-    kmers.remove_low_depth_kmers(filter_depth);
-    std::cerr << int_to_string(kmers.get_kmer_count()) << "\n";
+// Returns the read files in the directory which haven't been added yet, in name order. A file is only returned once
+// its size has stayed the same since the last check, so files which are still being written are left for later.
+static std::vector<std::string> find_new_read_files(std::string directory, const std::set<std::string> & added,
+                                                    std::map<std::string, long long> & sizes) {
+    std::vector<std::string> new_files;
+    DIR * dir = opendir(directory.c_str());
+    if (dir == NULL)
+        return new_files;
+    while (struct dirent * entry = readdir(dir)) {
+        std::string path = directory + "/" + entry->d_name;
+        struct stat info;
+        if (!is_read_file(entry->d_name) || added.count(path) > 0 || stat(path.c_str(), &info) != 0 ||
+                !S_ISREG(info.st_mode))
+            continue;
+        auto previous = sizes.find(path);
+        if (previous != sizes.end() && previous->second == (long long)info.st_size && info.st_size > 0)
+            new_files.push_back(path);
+        sizes[path] = (long long)info.st_size;
+    }
+    closedir(dir);
+    std::sort(new_files.begin(), new_files.end());
+    return new_files;
+}
 
-    std::cerr << "prune tips                         ";
-    kmers.remove_tips();
-    std::cerr << int_to_string(kmers.get_kmer_count()) << "\n";
 
-    std::cerr << "remove large differences           ";
-    kmers.remove_large_diff();
-    std::cerr << int_to_string(kmers.get_kmer_count()) << "\n";
+// Files are written to a temporary name and then renamed, so anything reading the snapshot never sees half of it.
+static bool write_snapshot(Kmers & kmers, int tip_length, Arguments & args, int update) {
+    int max_depth = kmers.get_max_depth();
+    int filter_depth = int(max_depth * args.filter_depth);
+    Kmers snapshot = kmers.get_filtered_copy(filter_depth);
+    std::vector<CleaningStep> steps = snapshot.clean(filter_depth, tip_length);
 
-    std::cerr << "remove singletons                  ";
-    kmers.remove_singletons();
-    std::cerr << int_to_string(kmers.get_kmer_count()) << "\n";
+    std::string filename = args.watch_prefix + ".gfa";
+    std::ofstream out(filename + ".tmp");
+    snapshot.output_gfa(out);
+    out.close();
+    if (!out || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+        std::cerr << "Error: failed writing " << filename << "\n";
+        return false;
+    }
+    if (!args.adapters_out.empty()) {
+        std::ofstream adapters_file(args.adapters_out + ".tmp");
+        snapshot.output_adapters_fasta(adapters_file);
+        adapters_file.close();
+        if (!adapters_file || std::rename((args.adapters_out + ".tmp").c_str(), args.adapters_out.c_str()) != 0) {
+            std::cerr << "Error: failed writing " << args.adapters_out << "\n";
+            return false;
+        }
+    }
+    std::cerr << "Update " << update << ": " << int_to_string(kmers.get_read_count()) << " reads, max depth "
+              << int_to_string(max_depth) << ", " << int_to_string(steps.back().remaining_kmers) << " "
+              << kmers.get_kmer_size() << "-mers after cleaning, saved to " << filename << "\n\n";
+    return true;
+}
 
-    kmers.output_gfa();
 
-    std::cerr << "\n";
-    return 0;
+// Returns the canonical absolute form of a directory's path, or the path unchanged if it can't be resolved.
+static std::string get_real_path(std::string path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == NULL)
+        return path;
+    return std::string(resolved);
+}
+
+
+// Keeps the k-mer table in memory and adds each new read file in the directory as it appears, checking every
+// watch_interval seconds. After each update, a cleaned copy of the table is saved as a snapshot. Polling is used
+// (rather than inotify) so this works on any platform and on network file systems.
+static bool run_watch(Kmers & kmers, Arguments & args) {
+    int tip_length = (args.tip_length > 0) ? args.tip_length : kmers.get_kmer_size();
+    std::set<std::string> added;
+    std::map<std::string, long long> sizes;
+    int update = 0;
+
+    // Read files given on the command line have been hashed already, so any which are in the watched directory are
+    // marked as added, under the same path find_new_read_files gives them.
+    std::string watch_dir = get_real_path(args.watch_dir);
+    for (auto read_file : args.input_reads) {
+        size_t slash = read_file.rfind('/');
+        std::string directory = (slash == std::string::npos) ? "." : read_file.substr(0, std::max(slash, size_t(1)));
+        std::string name = (slash == std::string::npos) ? read_file : read_file.substr(slash + 1);
+        if (get_real_path(directory) == watch_dir)
+            added.insert(args.watch_dir + "/" + name);
+    }
+    if (kmers.get_read_count() > 0 && !write_snapshot(kmers, tip_length, args, ++update))
+        return false;
+
+    std::cerr << "Watching " << args.watch_dir << " for new read files\n\n";
+    auto last_new_file = std::chrono::steady_clock::now();
+    while (true) {
+        std::vector<std::string> new_files = find_new_read_files(args.watch_dir, added, sizes);
+        auto now = std::chrono::steady_clock::now();
+        if (!new_files.empty()) {
+            for (auto read_file : new_files) {
+                kmers.add_fastq(read_file, args.start, args.end, args.margin);
+                added.insert(read_file);
+            }
+            if (!write_snapshot(kmers, tip_length, args, ++update))
+                return false;
+            last_new_file = std::chrono::steady_clock::now();
+        }
+        else if (args.watch_idle > 0 && now - last_new_file >= std::chrono::seconds(args.watch_idle)) {
+            std::cerr << "No new files for " << args.watch_idle << " seconds, stopping\n\n";
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(args.watch_interval));
+    }
+}
+
+
+// Lists the known adapters which match the cleaned graph, best first.
+static void print_known_adapter_matches(std::ostream & out, Kmers & kmers) {
+    std::vector<AdapterMatch> matches = match_known_adapters(kmers, kmers.get_adapter_paths());
+    if (matches.empty()) {
+        out << "No known adapters found\n\n";
+        return;
+    }
+    out << "Known adapter                      Identity   Containment\n";
+    out << "-------------------------------------------------------\n";
+    for (auto match : matches) {
+        std::string name = match.kit + " " + match.name;
+        name.resize(35, ' ');
+        std::ostringstream identity;
+        identity << std::fixed << std::setprecision(1) << 100.0 * match.identity << "%";
+        std::string identity_column = identity.str();
+        identity_column.resize(11, ' ');
+        out << name << identity_column << std::fixed << std::setprecision(1) << 100.0 * match.containment << "%\n";
+    }
+    out << "\n";
+}
+
+
+// Cleans a copy of the k-mer table for each filter depth fraction, in parallel, writing a GFA file for each and
+// listing its known adapter matches. The low-depth filter for the smallest fraction is common to every copy, so it
+// is applied once up front, which keeps the copies small.
+static bool run_sweep(Kmers & kmers, int max_depth, int tip_length, Arguments & args) {
+    std::vector<double> fractions = args.sweep;
+    size_t count = fractions.size();
+    double lowest_fraction = *std::min_element(fractions.begin(), fractions.end());
+    kmers.remove_low_depth_kmers(int(max_depth * lowest_fraction));
+
+    std::vector<std::string> filenames(count);
+    std::vector<std::vector<CleaningStep>> results(count);
+    std::vector<std::string> known_adapters(count);
+    std::vector<char> written(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        std::ostringstream filename;
+        filename << args.sweep_prefix << "_" << fractions[i] << ".gfa";
+        filenames[i] = filename.str();
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            Kmers sweep_kmers = kmers.get_frozen_copy();
+            sweep_kmers.set_threads(std::max(1, args.threads / int(count)));
+            results[i] = sweep_kmers.clean(int(max_depth * fractions[i]), tip_length);
+            if (!args.no_known_adapters) {
+                std::ostringstream known;
+                print_known_adapter_matches(known, sweep_kmers);
+                known_adapters[i] = known.str();
+            }
+            std::ofstream out(filenames[i]);
+            sweep_kmers.output_gfa(out);
+            written[i] = bool(out);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min(args.threads, int(count)); ++t)
+        threads.push_back(std::thread(worker));
+    for (auto & thread : threads)
+        thread.join();
+
+    bool all_written = true;
+    for (size_t i = 0; i < count; ++i) {
+        std::cerr << "Filter depth:  " << int(max_depth * fractions[i]) << " (" << fractions[i] << " of max)\n\n";
+        print_cleaning_table(std::cerr, results[i], kmers.get_kmer_size());
+        std::cerr << "\n" << known_adapters[i];
+        if (written[i])
+            std::cerr << "Graph saved to " << filenames[i] << "\n\n\n";
+        else {
+            std::cerr << "Error: failed writing " << filenames[i] << "\n\n\n";
+            all_written = false;
+        }
+    }
+    return all_written;
+}
+
+
+static bool save_adapters(Kmers & kmers, std::string filename) {
+    std::ofstream adapters_file(filename);
+    kmers.output_adapters_fasta(adapters_file);
+    if (!adapters_file) {
+        std::cerr << "Error: failed writing " << filename << "\n";
+        return false;
+    }
+    std::cerr << "Adapter sequences saved to " << filename << "\n\n";
+    return true;
+}
+
+
+// Trims the reads using the cleaned k-mers as the adapter set, writing the trimmed reads to stdout.
+static bool run_trim(Kmers & kmers, Arguments & args, ProgressReporter & progress) {
+    Trimmer trimmer(kmers);
+    progress.start("trimming", args.input_reads);
+    trimmer.set_progress(&progress);
+    for (auto read_file : args.input_reads) {
+        if (!trimmer.trim_fastq(read_file, std::cout, args.threads)) {
+            progress.finish();
+            return false;
+        }
+    }
+    progress.finish();
+    trimmer.print_summary();
+    return bool(std::cout);
+}
+
+
+// Checks the reads for the cleaned k-mers, writing a JSON report to stdout.
+static bool run_scan(Kmers & kmers, Arguments & args, ProgressReporter & progress) {
+    Scanner scanner(kmers);
+    progress.start("scanning", args.input_reads);
+    scanner.set_progress(&progress);
+    for (auto read_file : args.input_reads) {
+        if (!scanner.scan_fastq(read_file, args.threads)) {
+            progress.finish();
+            return false;
+        }
+    }
+    progress.finish();
+    scanner.print_summary();
+    scanner.output_json(std::cout);
+    return bool(std::cout);
+}
+
+
+// Cleans the table for each barcode in parallel, writing a GFA file for each. The filter depth is relative to each
+// barcode's own max depth, so barcodes with fewer reads aren't filtered away.
+static bool run_barcode_clusters(Kmers & kmers, int tip_length, Arguments & args) {
+    size_t count = size_t(kmers.get_cluster_count());
+    std::vector<std::string> filenames(count);
+    std::vector<int> filter_depths(count, 0);
+    std::vector<std::vector<CleaningStep>> results(count);
+    std::vector<std::string> known_adapters(count);
+    std::vector<char> written(count, 0);
+    for (size_t i = 0; i < count; ++i)
+        filenames[i] = args.barcode_prefix + "_" + kmers.get_cluster_name(int(i)) + ".gfa";
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            Kmers & cluster = kmers.get_cluster(int(i));
+            if (cluster.get_read_count() == 0)
+                continue;
+            cluster.set_threads(std::max(1, args.threads / int(count)));
+            filter_depths[i] = int(cluster.get_max_depth() * args.filter_depth);
+            results[i] = cluster.clean(filter_depths[i], tip_length);
+            std::ofstream out(filenames[i]);
+            cluster.output_gfa(out);
+            written[i] = bool(out);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min(args.threads, int(count)); ++t)
+        threads.push_back(std::thread(worker));
+    for (auto & thread : threads)
+        thread.join();
+
+    bool all_written = true;
+    for (size_t i = 0; i < count; ++i) {
+        Kmers & cluster = kmers.get_cluster(int(i));
+        std::cerr << "Barcode " << kmers.get_cluster_name(int(i)) << ": "
+                  << int_to_string(cluster.get_read_count()) << " reads\n";
+        if (cluster.get_read_count() == 0) {
+            std::cerr << "  no graph made\n\n\n";
+            continue;
+        }
+        std::cerr << "Filter depth:  " << filter_depths[i] << "\n\n";
+        print_cleaning_table(std::cerr, results[i], kmers.get_kmer_size());
+        std::cerr << "\n" << known_adapters[i];
+        if (written[i])
+            std::cerr << "Graph saved to " << filenames[i] << "\n\n\n";
+        else {
+            std::cerr << "Error: failed writing " << filenames[i] << "\n\n\n";
+            all_written = false;
+        }
+    }
+    return all_written;
+}
+
+
+// Assembles each sample in the manifest separately, writing a GFA file for each. Samples are spread over the
+// threads, and each thread reuses one k-mer table for all of its samples. Per-file progress would be interleaved, so
+// the tables are quiet, the reporter shows the combined progress of all threads, and each sample's summary is printed
+// as a block, in manifest order, once it is done.
+static bool run_batch(Arguments & args, ProgressReporter & progress) {
+    size_t count = args.samples.size();
+    int worker_count = std::min(args.threads, int(count));
+    std::cerr << "Assembling " << count << " sample" << (count == 1 ? "" : "s") << " using " << worker_count
+              << " thread" << (worker_count == 1 ? "" : "s") << "\n\n";
+
+    std::vector<std::string> reports(count);
+    std::vector<char> done(count, 0);
+    std::vector<char> written(count, 0);
+    size_t next_report = 0;
+    std::mutex report_mutex;
+
+    std::vector<std::string> all_read_files;
+    for (auto & sample : args.samples)
+        all_read_files.insert(all_read_files.end(), sample.read_files.begin(), sample.read_files.end());
+    progress.start("assembling", all_read_files);
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        Kmers kmers(args.kmer);
+        kmers.set_threads(std::max(1, args.threads / worker_count));
+        kmers.set_positional(args.positional);
+        kmers.set_distinct(args.distinct);
+        kmers.set_canonical(args.canonical);
+        kmers.set_quiet(true);
+        kmers.set_progress(&progress);
+
+        size_t i;
+        while ((i = next++) < count) {
+            const Sample & sample = args.samples[i];
+            kmers.clear();
+            kmers.set_read_limit(args.max_reads, args.sample_fraction);
+            if (args.converge)
+                kmers.set_convergence(args.filter_depth, args.converge_tolerance);
+            for (auto read_file : sample.read_files) {
+                if (!kmers.add_fastq(read_file, args.start, args.end, args.margin))
+                    break;
+            }
+
+            std::ostringstream report;
+            report << "Sample " << sample.name << ": " << int_to_string(kmers.get_read_count()) << " reads, "
+                   << int_to_string(kmers.get_kmer_count()) << " " << args.kmer << "-mers\n";
+            int max_depth = kmers.get_max_depth();
+            int filter_depth = int(max_depth * args.filter_depth);
+            int tip_length = (args.tip_length > 0) ? args.tip_length : args.kmer;
+            report << "Maximum depth: " << max_depth << "\n";
+            report << "Filter depth:  " << filter_depth << "\n\n";
+            print_cleaning_table(report, kmers.clean(filter_depth, tip_length), args.kmer);
+            report << "\n";
+            if (!args.no_known_adapters)
+                print_known_adapter_matches(report, kmers);
+
+            std::string filename = args.batch_dir + "/" + sample.name + ".gfa";
+            std::ofstream out(filename);
+            kmers.output_gfa(out);
+            written[i] = bool(out);
+            if (written[i])
+                report << "Graph saved to " << filename << "\n\n\n";
+            else
+                report << "Error: failed writing " << filename << "\n\n\n";
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            reports[i] = report.str();
+            done[i] = 1;
+            while (next_report < count && done[next_report])
+                progress.print(reports[next_report++]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < worker_count; ++t)
+        threads.push_back(std::thread(worker));
+    for (auto & thread : threads)
+        thread.join();
+    progress.finish();
+
+    return std::find(written.begin(), written.end(), 0) == written.end();
 }
@@ -17,18 +17,84 @@
 #include "misc.h"
 
 #include <iostream>
-#include <sstream>
-#include <iomanip>
+#include <locale>
+#include <chrono>
+#include <stdexcept>
+#include <climits>
 
 
+struct NumberFormat
+{
+    char separator;
+    std::string grouping;
+};
+
+
+// The digit grouping comes from the user's locale, but constructing a locale is slow (and can take a global lock),
+// so it is only done once. An unknown locale falls back to plain digits.
+static NumberFormat get_number_format() {
+    std::locale locale = std::locale::classic();
+    try {
+        locale = std::locale("");
+    }
+    catch (std::runtime_error &) {}
+    const std::numpunct<char> & punct = std::use_facet<std::numpunct<char>>(locale);
+    return {punct.thousands_sep(), punct.grouping()};
+}
+
+
+// Digits are written from the right. Each character of the grouping is the size of the next group, with the last
+// repeating, and a size of zero or less (or CHAR_MAX) means the rest aren't grouped.
 std::string int_to_string(long long n) {
-    std::stringstream ss;
-    ss.imbue(std::locale(""));
-    ss << std::fixed << n;
-    return ss.str();
+    static const NumberFormat format = get_number_format();
+
+    unsigned long long magnitude = (n < 0) ? 0ULL - (unsigned long long)(n) : (unsigned long long)(n);
+    char buffer[64];
+    char * p = buffer + sizeof(buffer);
+    size_t group = 0;
+    int group_size = format.grouping.empty() ? 0 : format.grouping[0];
+    int in_group = 0;
+    do {
+        if (group_size > 0 && group_size != CHAR_MAX && in_group == group_size) {
+            *--p = format.separator;
+            in_group = 0;
+            if (group + 1 < format.grouping.size())
+                group_size = format.grouping[++group];
+        }
+        *--p = char('0' + magnitude % 10);
+        magnitude /= 10;
+        ++in_group;
+    } while (magnitude > 0);
+    if (n < 0)
+        *--p = '-';
+    return std::string(p, buffer + sizeof(buffer) - p);
+}
+
+
+void print_hash_progress(std::ostream & out, std::string filename, long long base_count) {
+    out << "\r  " << filename << " (" << int_to_string(base_count) << " bp)";
+}
+
+
+static long long get_time_ns() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+
+ProgressThrottle::ProgressThrottle(double max_per_second) :
+    m_interval((long long)(1e9 / max_per_second)),
+    m_next_update(get_time_ns() + m_interval)
+{
 }
 
 
-void print_hash_progress(std::string filename, long long base_count) {
-    std::cerr << "\r  " << filename << " (" << int_to_string(base_count) << " bp)";
+// A thread which finds the next update due claims it by moving the due time on. If another thread got there first,
+// the exchange fails and this one skips the update.
+bool ProgressThrottle::ready() {
+    long long now = get_time_ns();
+    long long next_update = m_next_update.load(std::memory_order_relaxed);
+    if (now < next_update)
+        return false;
+    return m_next_update.compare_exchange_strong(next_update, now + m_interval, std::memory_order_relaxed);
 }
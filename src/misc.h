@@ -17,10 +17,26 @@
 #define MISC_H
 
 #include <string>
+#include <ostream>
+#include <atomic>
 
 std::string int_to_string(long long n);
 
-void print_hash_progress(std::string filename, long long base_count);
+void print_hash_progress(std::ostream & out, std::string filename, long long base_count);
+
+
+// Limits how often progress is shown: ready() returns true at most max_per_second times a second. It is lock-free,
+// so any number of threads can ask, and only one of them gets each update.
+class ProgressThrottle
+{
+public:
+    ProgressThrottle(double max_per_second = 10.0);
+    bool ready();
+
+private:
+    long long m_interval;
+    std::atomic<long long> m_next_update;
+};
 
 
 #endif // MISC_H
@@ -0,0 +1,183 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "progress.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <sys/stat.h>
+#include "misc.h"
+
+
+// When the output isn't a terminal, a progress line is logged this often (in seconds).
+#define LOG_INTERVAL 10
+
+
+int ReporterBuffer::overflow(int c) {
+    if (c == '\n') {
+        m_reporter.print(m_line + "\n");
+        m_line.clear();
+    }
+    else if (c == '\r')
+        m_line.clear();
+    else if (c != EOF)
+        m_line += char(c);
+    return c;
+}
+
+
+ProgressReporter::ProgressReporter(std::ostream & out, bool terminal) :
+    m_out(out),
+    m_terminal(terminal),
+    m_total_bytes(0),
+    m_running(false),
+    m_status_length(0),
+    m_log_buffer(*this),
+    m_log_stream(&m_log_buffer)
+{
+}
+
+
+ProgressReporter::~ProgressReporter() {
+    finish();
+}
+
+
+// The file sizes are only used for the ETA, so a file which can't be read (yet) just counts as empty.
+void ProgressReporter::start(std::string stage, const std::vector<std::string> & files) {
+    finish();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stage = stage;
+    m_total_bytes = 0;
+    for (auto & filename : files) {
+        struct stat info;
+        if (stat(filename.c_str(), &info) == 0)
+            m_total_bytes += (long long)info.st_size;
+    }
+    for (auto & counters : m_counters) {
+        counters->reads.store(0);
+        counters->bases.store(0);
+        counters->input_bytes.store(0);
+    }
+    m_start_time = std::chrono::steady_clock::now();
+    m_running = true;
+    m_thread = std::thread(&ProgressReporter::run, this);
+}
+
+
+// Stops the reporter thread and prints the stage's totals.
+void ProgressReporter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    clear_status();
+    m_out << get_status(true) << "\n\n";
+    m_out.flush();
+}
+
+
+// The counters are kept until the reporter is destroyed (they are only zeroed for the next stage), so a thread can
+// hold on to its pointer.
+ProgressCounters * ProgressReporter::add_counters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters.push_back(std::unique_ptr<ProgressCounters>(new ProgressCounters()));
+    return m_counters.back().get();
+}
+
+
+// Prints whole lines. The status line is cleared first and comes back at the next update.
+void ProgressReporter::print(const std::string & text) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    clear_status();
+    m_out << text;
+    m_out.flush();
+}
+
+
+void ProgressReporter::run() {
+    std::chrono::milliseconds interval(m_terminal ? 100 : LOG_INTERVAL * 1000);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait_for(lock, interval, [this]() {return !m_running;});
+        if (!m_running)
+            return;
+        std::string status = get_status(false);
+        if (m_terminal) {
+            m_out << "\r" << status;
+            if (status.size() < m_status_length)
+                m_out << std::string(m_status_length - status.size(), ' ');
+            m_status_length = status.size();
+        }
+        else
+            m_out << status << "\n";
+        m_out.flush();
+    }
+}
+
+
+static std::string format_duration(double seconds) {
+    long long total = (long long)(seconds + 0.5);
+    std::ostringstream out;
+    if (total >= 3600)
+        out << total / 3600 << ":" << std::setw(2) << std::setfill('0') << (total / 60) % 60;
+    else
+        out << total / 60;
+    out << ":" << std::setw(2) << std::setfill('0') << total % 60;
+    return out.str();
+}
+
+
+// Rates are averages over the whole stage so far. The ETA assumes the rest of the input is read at the same rate,
+// and is left out when the total input size isn't known.
+std::string ProgressReporter::get_status(bool final) {
+    long long reads = 0, bases = 0, input_bytes = 0;
+    for (auto & counters : m_counters) {
+        reads += counters->reads.load(std::memory_order_relaxed);
+        bases += counters->bases.load(std::memory_order_relaxed);
+        input_bytes += counters->input_bytes.load(std::memory_order_relaxed);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start_time;
+    double seconds = std::max(elapsed.count(), 0.001);
+
+    std::ostringstream status;
+    status << std::fixed << std::setprecision(1);
+    status << "  " << m_stage << ": " << int_to_string(reads) << " reads, " << bases / 1e6 << " Mbp";
+    if (final)
+        status << " in " << format_duration(seconds);
+    status << " (" << int_to_string((long long)(reads / seconds)) << " reads/s, " << bases / 1e6 / seconds
+           << " Mbp/s, " << input_bytes / 1e6 / seconds << " MB/s input)";
+    if (!final && m_total_bytes > 0 && input_bytes > 0) {
+        double fraction = std::min(1.0, double(input_bytes) / m_total_bytes);
+        status << ", " << int(fraction * 100.0) << "%, ETA " << format_duration(seconds * (1.0 - fraction) / fraction);
+    }
+    return status.str();
+}
+
+
+void ProgressReporter::clear_status() {
+    if (m_status_length == 0)
+        return;
+    m_out << "\r" << std::string(m_status_length, ' ') << "\r";
+    m_status_length = 0;
+}
@@ -0,0 +1,109 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+
+#include <string>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+
+class ProgressReporter;
+
+
+// Counts from one reading thread. Each thread has its own (padded so no two share a cache line), so updates never
+// contend, and the reporter only ever reads them. The input bytes are the position reached in the files, as
+// reported by gzoffset (compressed bytes for gzipped files).
+struct ProgressCounters
+{
+    ProgressCounters() : reads(0), bases(0), input_bytes(0) {}
+    void add_reads(long long read_count, long long base_count) {
+        reads.fetch_add(read_count, std::memory_order_relaxed);
+        bases.fetch_add(base_count, std::memory_order_relaxed);
+    }
+    void set_input_bytes(long long byte_count) {input_bytes.store(byte_count, std::memory_order_relaxed);}
+
+    char padding_before[64];
+    std::atomic<long long> reads;
+    std::atomic<long long> bases;
+    std::atomic<long long> input_bytes;
+    char padding_after[64];
+};
+
+
+// A stream buffer which passes each complete line to the reporter. A carriage return starts the line again, so
+// in-place progress updates written to it are dropped (the reporter shows progress itself).
+class ReporterBuffer : public std::streambuf
+{
+public:
+    ReporterBuffer(ProgressReporter & reporter) : m_reporter(reporter) {}
+
+protected:
+    int overflow(int c);
+
+private:
+    ProgressReporter & m_reporter;
+    std::string m_line;
+};
+
+
+// Shows the progress of one stage of a run (hashing, trimming, etc.) over all of its input files, however many
+// threads are reading them. Each reading thread takes its own counters with add_counters. One reporter thread adds
+// them up and shows the totals and rates: on a terminal, as a status line redrawn ten times a second, and otherwise
+// as a log line every LOG_INTERVAL seconds. Anything else written to the terminal during the stage should go through
+// print (from any thread) or log (from one thread), so it doesn't get mixed up with the status line.
+class ProgressReporter
+{
+public:
+    ProgressReporter(std::ostream & out, bool terminal);
+    ~ProgressReporter();
+
+    void start(std::string stage, const std::vector<std::string> & files);
+    void finish();
+    ProgressCounters * add_counters();
+    void print(const std::string & text);
+    std::ostream & log() {return m_log_stream;}
+
+private:
+    std::ostream & m_out;
+    bool m_terminal;
+    std::string m_stage;
+    long long m_total_bytes;
+    std::chrono::steady_clock::time_point m_start_time;
+    std::vector<std::unique_ptr<ProgressCounters>> m_counters;
+    bool m_running;
+    size_t m_status_length;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    ReporterBuffer m_log_buffer;
+    std::ostream m_log_stream;
+
+    void run();
+    std::string get_status(bool final);
+    void clear_status();
+};
+
+
+#endif // PROGRESS_H
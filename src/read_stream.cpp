@@ -0,0 +1,156 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "read_stream.h"
+
+#include <iostream>
+#include <zlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include "kseq.h"
+
+KSEQ_INIT(gzFile, gzread)
+
+// A batch is full at whichever of these limits is reached first.
+#define READS_PER_BATCH 4096
+#define BASES_PER_BATCH 4000000
+
+
+// Reads the file in batches, running process on each batch in one of the worker threads and then finish on each
+// batch in input order, one at a time. Reading, processing and finishing all overlap, and the number of batches in
+// flight is bounded, so memory use doesn't depend on the file size. Progress is counted by the reading thread, one
+// batch at a time. Errors go through the reporter, if there is one, so they don't land in the middle of its status
+// line.
+bool stream_reads(std::string filename, int threads, std::function<void(ReadBatch &)> process,
+                  std::function<void(ReadBatch &)> finish, ProgressCounters * progress,
+                  ProgressReporter * reporter) {
+    auto print_error = [reporter](const std::string & error) {
+        if (reporter)
+            reporter->print(error);
+        else
+            std::cerr << error;
+    };
+    gzFile fp = gzopen(filename.c_str(), "r");
+    if (fp == NULL) {
+        print_error("Error: cannot open " + filename + "\n");
+        return false;
+    }
+    kseq_t * seq = kseq_init(fp);
+    long long input_start = progress ? progress->input_bytes.load() : 0;
+
+    std::vector<std::unique_ptr<ReadBatch>> batches;
+    std::vector<ReadBatch *> free_batches;
+    for (int i = 0; i < 2 * threads + 2; ++i) {
+        batches.push_back(std::unique_ptr<ReadBatch>(new ReadBatch()));
+        free_batches.push_back(batches.back().get());
+    }
+    std::deque<std::pair<size_t, ReadBatch *>> to_process;
+    std::map<size_t, ReadBatch *> processed;
+    size_t batches_read = 0;
+    bool reading_done = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() {return !to_process.empty() || reading_done;});
+            if (to_process.empty())
+                return;
+            auto item = to_process.front();
+            to_process.pop_front();
+            lock.unlock();
+            process(*item.second);
+            lock.lock();
+            processed[item.first] = item.second;
+            changed.notify_all();
+        }
+    };
+    auto finisher = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t next = 0; ; ++next) {
+            changed.wait(lock, [&]() {return processed.count(next) > 0 || (reading_done && next == batches_read);});
+            if (processed.count(next) == 0)
+                return;
+            ReadBatch * batch = processed[next];
+            processed.erase(next);
+            lock.unlock();
+            finish(*batch);
+            lock.lock();
+            free_batches.push_back(batch);
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.push_back(std::thread(worker));
+    std::thread finish_thread(finisher);
+
+    bool good = true;
+    int l = 0;
+    while (l >= 0) {
+        ReadBatch * batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() {return !free_batches.empty();});
+            batch = free_batches.back();
+            free_batches.pop_back();
+        }
+        batch->count = 0;
+        batch->output.clear();
+        size_t base_count = 0;
+        while (batch->count < READS_PER_BATCH && base_count < BASES_PER_BATCH && (l = kseq_read(seq)) >= 0) {
+            if (batch->count == batch->reads.size())
+                batch->reads.emplace_back();
+            ReadRecord & read = batch->reads[batch->count++];
+            read.name.assign(seq->name.s, seq->name.l);
+            read.comment.assign(seq->comment.l ? seq->comment.s : "", seq->comment.l);
+            read.sequence.assign(seq->seq.s, seq->seq.l);
+            read.quality.assign(seq->qual.l ? seq->qual.s : "", seq->qual.l);
+            base_count += seq->seq.l;
+        }
+        if (l < -1) {
+            print_error("Error reading " + filename + "\n");
+            good = false;
+        }
+        if (progress) {
+            progress->add_reads((long long)batch->count, (long long)base_count);
+            progress->set_input_bytes(input_start + gzoffset(fp));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (batch->count == 0)
+            free_batches.push_back(batch);
+        else
+            to_process.push_back(std::make_pair(batches_read++, batch));
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reading_done = true;
+        changed.notify_all();
+    }
+    for (auto & thread : workers)
+        thread.join();
+    finish_thread.join();
+
+    kseq_destroy(seq);
+    gzclose(fp);
+    return good;
+}
@@ -0,0 +1,51 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef READ_STREAM_H
+#define READ_STREAM_H
+
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "progress.h"
+
+
+struct ReadRecord
+{
+    std::string name;
+    std::string comment;
+    std::string sequence;
+    std::string quality;
+};
+
+
+// A batch of consecutive reads. Batches are reused, so the records past count are left over from earlier batches
+// and their strings keep their memory. The output string is for whatever the batch's results are written as.
+struct ReadBatch
+{
+    std::vector<ReadRecord> reads;
+    size_t count;
+    std::string output;
+};
+
+
+bool stream_reads(std::string filename, int threads, std::function<void(ReadBatch &)> process,
+                  std::function<void(ReadBatch &)> finish, ProgressCounters * progress = NULL,
+                  ProgressReporter * reporter = NULL);
+
+
+#endif // READ_STREAM_H
@@ -0,0 +1,161 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "scanner.h"
+
+#include <iostream>
+#include <iomanip>
+
+#include "misc.h"
+
+
+static void output_json_histogram(std::ostream & out, const std::vector<long long> & counts);
+static double get_rate(long long count, long long total);
+
+
+Scanner::Scanner(Kmers & kmers) :
+    m_finder(kmers),
+    m_progress(NULL),
+    m_progress_counters(NULL),
+    m_kmer_size(kmers.get_kmer_size())
+{
+    m_stats = empty_stats();
+}
+
+
+bool Scanner::scan_fastq(std::string filename, int threads) {
+    (m_progress ? m_progress->log() : std::cerr) << "Scanning " << filename << "\n";
+    return stream_reads(filename, threads, [this](ReadBatch & batch) {scan_batch(batch);},
+                        [](ReadBatch &) {}, m_progress_counters, m_progress);
+}
+
+
+void Scanner::set_progress(ProgressReporter * progress) {
+    m_progress = progress;
+    m_progress_counters = progress ? progress->add_counters() : NULL;
+}
+
+
+void Scanner::print_summary() {
+    std::cerr << "  " << int_to_string(m_stats.read_count) << " reads";
+    if (m_finder.get_start())
+        std::cerr << ", " << int_to_string(m_stats.start_count) << " with start adapters";
+    if (m_finder.get_end())
+        std::cerr << ", " << int_to_string(m_stats.end_count) << " with end adapters";
+    std::cerr << "\n  " << int_to_string(m_stats.middle_count) << " with adapters in the middle\n\n";
+}
+
+
+void Scanner::output_json(std::ostream & out) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"reads\": " << m_stats.read_count << ",\n";
+    out << "  \"bases\": " << m_stats.base_count << ",\n";
+    out << "  \"kmer_size\": " << m_kmer_size << ",\n";
+    out << "  \"margin\": " << m_finder.get_margin() << ",\n";
+    if (m_finder.get_start()) {
+        out << "  \"start\": {\n";
+        out << "    \"reads_with_adapter\": " << m_stats.start_count << ",\n";
+        out << "    \"presence_rate\": " << get_rate(m_stats.start_count, m_stats.read_count) << ",\n";
+        out << "    \"offset_histogram\": ";
+        output_json_histogram(out, m_stats.start_offsets);
+        out << "\n  },\n";
+    }
+    if (m_finder.get_end()) {
+        out << "  \"end\": {\n";
+        out << "    \"reads_with_adapter\": " << m_stats.end_count << ",\n";
+        out << "    \"presence_rate\": " << get_rate(m_stats.end_count, m_stats.read_count) << ",\n";
+        out << "    \"offset_histogram\": ";
+        output_json_histogram(out, m_stats.end_offsets);
+        out << "\n  },\n";
+    }
+    out << "  \"chimeras\": {\n";
+    out << "    \"reads_with_middle_adapter\": " << m_stats.middle_count << ",\n";
+    out << "    \"rate\": " << get_rate(m_stats.middle_count, m_stats.read_count) << "\n";
+    out << "  }\n";
+    out << "}\n";
+}
+
+
+// Each batch is tallied on its own and then added to the totals, so the lock is only taken once per batch.
+void Scanner::scan_batch(ReadBatch & batch) {
+    ScanStats stats = empty_stats();
+    for (size_t i = 0; i < batch.count; ++i) {
+        const std::string & sequence = batch.reads[i].sequence;
+        int length = int(sequence.size());
+        int start_range_end, end_range_start;
+        m_finder.get_windows(length, start_range_end, end_range_start);
+        ++stats.read_count;
+        stats.base_count += length;
+        if (m_finder.get_start()) {
+            int adapter_end = m_finder.find_start_adapter(sequence, start_range_end);
+            if (adapter_end > 0) {
+                ++stats.start_count;
+                ++stats.start_offsets[size_t(std::min(adapter_end, m_finder.get_margin()))];
+            }
+        }
+        if (m_finder.get_end()) {
+            int adapter_start = m_finder.find_end_adapter(sequence, end_range_start);
+            if (adapter_start < length) {
+                ++stats.end_count;
+                ++stats.end_offsets[size_t(std::min(length - adapter_start, m_finder.get_margin()))];
+            }
+        }
+        if (m_finder.find_middle_adapter(sequence))
+            ++stats.middle_count;
+    }
+
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.read_count += stats.read_count;
+    m_stats.base_count += stats.base_count;
+    m_stats.start_count += stats.start_count;
+    m_stats.end_count += stats.end_count;
+    m_stats.middle_count += stats.middle_count;
+    for (size_t i = 0; i < stats.start_offsets.size(); ++i) {
+        m_stats.start_offsets[i] += stats.start_offsets[i];
+        m_stats.end_offsets[i] += stats.end_offsets[i];
+    }
+}
+
+
+ScanStats Scanner::empty_stats() {
+    ScanStats stats;
+    stats.read_count = 0;
+    stats.base_count = 0;
+    stats.start_count = 0;
+    stats.end_count = 0;
+    stats.middle_count = 0;
+    stats.start_offsets.assign(size_t(m_finder.get_margin()) + 1, 0);
+    stats.end_offsets.assign(size_t(m_finder.get_margin()) + 1, 0);
+    return stats;
+}
+
+
+// Trailing empty bins are left off.
+static void output_json_histogram(std::ostream & out, const std::vector<long long> & counts) {
+    size_t size = counts.size();
+    while (size > 0 && counts[size - 1] == 0)
+        --size;
+    out << "[";
+    for (size_t i = 0; i < size; ++i)
+        out << (i > 0 ? ", " : "") << counts[i];
+    out << "]";
+}
+
+
+static double get_rate(long long count, long long total) {
+    return (total > 0) ? double(count) / double(total) : 0.0;
+}
@@ -0,0 +1,69 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+
+#include <string>
+#include <ostream>
+#include <vector>
+#include <mutex>
+
+#include "kmers.h"
+#include "adapter_finder.h"
+#include "read_stream.h"
+
+
+// The offsets are where the adapter stops, counted from the read start (for start adapters) or the read end (for end
+// adapters), so each histogram has one bin per base of the margin.
+struct ScanStats
+{
+    long long read_count;
+    long long base_count;
+    long long start_count;
+    long long end_count;
+    long long middle_count;
+    std::vector<long long> start_offsets;
+    std::vector<long long> end_offsets;
+};
+
+
+// Checks each read for the adapters of a cleaned graph and summarises how many reads have them, where, and how many
+// have adapters away from the read ends (a sign of chimeric reads).
+class Scanner
+{
+public:
+    Scanner(Kmers & kmers);
+
+    bool scan_fastq(std::string filename, int threads);
+    void set_progress(ProgressReporter * progress);
+    void output_json(std::ostream & out);
+    void print_summary();
+
+private:
+    AdapterFinder m_finder;
+    ProgressReporter * m_progress;
+    ProgressCounters * m_progress_counters;
+    int m_kmer_size;
+    ScanStats m_stats;
+    std::mutex m_stats_mutex;
+
+    void scan_batch(ReadBatch & batch);
+    ScanStats empty_stats();
+};
+
+
+#endif // SCANNER_H
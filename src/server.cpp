@@ -0,0 +1,237 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "server.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+struct Job
+{
+    std::string id;
+    std::vector<std::string> read_files;
+    AssemblerOptions options;
+    bool fasta;
+    std::string error;
+};
+
+
+// Finished jobs hand their assembler back here, so the next job with the same k-mer size can reuse its table. At most
+// max_idle assemblers are kept.
+class AssemblerPool
+{
+public:
+    AssemblerPool(size_t max_idle) : m_max_idle(max_idle) {}
+    std::unique_ptr<AdapterAssembler> take(AssemblerOptions options);
+    void give(std::unique_ptr<AdapterAssembler> assembler);
+
+private:
+    size_t m_max_idle;
+    std::mutex m_mutex;
+    std::deque<std::unique_ptr<AdapterAssembler>> m_idle;
+};
+
+
+static Job parse_job(const std::string & line, AssemblerOptions defaults, int job_number);
+static void run_job(Job & job, AssemblerPool & pool, std::ostream & response);
+
+
+std::unique_ptr<AdapterAssembler> AssemblerPool::take(AssemblerOptions options) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_idle.begin(); it != m_idle.end(); ++it) {
+            if ((*it)->get_kmer_size() == options.kmer) {
+                std::unique_ptr<AdapterAssembler> assembler = std::move(*it);
+                m_idle.erase(it);
+                assembler->set_options(options);
+                return assembler;
+            }
+        }
+    }
+    return std::unique_ptr<AdapterAssembler>(new AdapterAssembler(options));
+}
+
+
+void AssemblerPool::give(std::unique_ptr<AdapterAssembler> assembler) {
+    assembler->reset();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idle.push_back(std::move(assembler));
+    if (m_idle.size() > m_max_idle)
+        m_idle.pop_front();
+}
+
+
+// Reads one job per line from in and runs them on a pool of worker threads, writing each job's result to out as soon
+// as it is done (so not necessarily in input order). A job line is a list of settings, e.g.:
+//   id=sample_1 files=a.fastq.gz,b.fastq.gz k=12 margin=200 filter_depth=0.05 start output=fasta
+// Settings which aren't given take the server's defaults. Each result starts with '#job ID ok' (or '#job ID error
+// MESSAGE') and finishes with '#end ID'. The server stops at the end of the input or at a 'quit' line, once every job
+// is done.
+int run_server(std::istream & in, std::ostream & out, AssemblerOptions defaults, int threads) {
+    std::deque<Job> queue;
+    bool input_done = false;
+    std::mutex queue_mutex, output_mutex;
+    std::condition_variable queue_changed;
+    AssemblerPool pool(static_cast<size_t>(threads));
+
+    auto worker = [&]() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_changed.wait(lock, [&]() {return !queue.empty() || input_done;});
+                if (queue.empty())
+                    return;
+                job = queue.front();
+                queue.pop_front();
+            }
+            std::ostringstream response;
+            run_job(job, pool, response);
+            std::lock_guard<std::mutex> lock(output_mutex);
+            out << response.str() << std::flush;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.push_back(std::thread(worker));
+
+    std::cerr << "Waiting for jobs on stdin, using " << threads << " thread" << (threads == 1 ? "" : "s") << "\n";
+    std::string line;
+    int job_count = 0;
+    while (std::getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#')
+            continue;
+        if (line == "quit")
+            break;
+        Job job = parse_job(line, defaults, ++job_count);
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(job);
+        queue_changed.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        input_done = true;
+        queue_changed.notify_all();
+    }
+    for (auto & thread : workers)
+        thread.join();
+    std::cerr << "Finished " << job_count << " job" << (job_count == 1 ? "" : "s") << "\n";
+    return 0;
+}
+
+
+// Problems with the job are saved in its error, to be reported in its response.
+static Job parse_job(const std::string & line, AssemblerOptions defaults, int job_number) {
+    Job job;
+    job.id = "job_" + std::to_string(job_number);
+    job.options = defaults;
+    job.options.threads = 1;
+    job.fasta = false;
+
+    std::istringstream fields(line);
+    std::string field;
+    bool start_given = false, end_given = false;
+    while (fields >> field) {
+        size_t equals = field.find('=');
+        std::string key = field.substr(0, equals);
+        std::string value = (equals == std::string::npos) ? "" : field.substr(equals + 1);
+        try {
+            if (key == "id")
+                job.id = value;
+            else if (key == "files") {
+                std::istringstream files(value);
+                std::string file;
+                while (std::getline(files, file, ','))
+                    job.read_files.push_back(file);
+            }
+            else if (key == "k")
+                job.options.kmer = std::stoi(value);
+            else if (key == "margin")
+                job.options.margin = std::stoi(value);
+            else if (key == "filter_depth")
+                job.options.filter_depth = std::stod(value);
+            else if (key == "tip_length")
+                job.options.tip_length = std::stoi(value);
+            else if (key == "output" && (value == "gfa" || value == "fasta"))
+                job.fasta = (value == "fasta");
+            else if (key == "start")
+                start_given = true;
+            else if (key == "end")
+                end_given = true;
+            else if (key == "canonical")
+                job.options.canonical = true;
+            else if (key == "distinct")
+                job.options.distinct = true;
+            else if (job.error.empty())
+                job.error = "unknown setting " + field;
+        }
+        catch ( ... ) {
+            if (job.error.empty())
+                job.error = "invalid value in " + field;
+        }
+    }
+    if (start_given || end_given) {
+        job.options.start = start_given;
+        job.options.end = end_given;
+    }
+
+    if (!job.error.empty())
+        return job;
+    if (job.read_files.empty())
+        job.error = "no read files given";
+    else if (job.options.kmer < 4 || job.options.kmer > 16)
+        job.error = "k must be between 4 and 16 (inclusive)";
+    else if (job.options.margin < job.options.kmer)
+        job.error = "margin cannot be less than k";
+    else if (job.options.filter_depth < 0.0 || job.options.filter_depth > 1.0)
+        job.error = "filter_depth must be between 0 and 1 (inclusive)";
+    else if (job.options.start && job.options.end && !job.options.canonical)
+        job.error = "start and end can only be used together with canonical";
+    for (auto file : job.read_files) {
+        if (job.error.empty() && !std::ifstream(file).good())
+            job.error = "cannot find file " + file;
+    }
+    return job;
+}
+
+
+static void run_job(Job & job, AssemblerPool & pool, std::ostream & response) {
+    if (!job.error.empty()) {
+        response << "#job " << job.id << " error " << job.error << "\n#end " << job.id << "\n";
+        return;
+    }
+    std::unique_ptr<AdapterAssembler> assembler = pool.take(job.options);
+    assembler->set_log_callback([](const std::string &) {});
+    for (auto file : job.read_files)
+        assembler->add_fastq(file);
+
+    response << "#job " << job.id << " ok reads=" << assembler->get_read_count() << "\n";
+    if (job.fasta)
+        assembler->write_adapters_fasta(response);
+    else
+        assembler->write_gfa(response);
+    response << "#end " << job.id << "\n";
+    pool.give(std::move(assembler));
+}
@@ -0,0 +1,103 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "trimmer.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "misc.h"
+
+
+Trimmer::Trimmer(Kmers & kmers) :
+    m_finder(kmers),
+    m_progress(NULL),
+    m_progress_counters(NULL),
+    m_read_count(0),
+    m_start_trim_count(0),
+    m_end_trim_count(0),
+    m_removed_read_count(0),
+    m_removed_base_count(0)
+{
+}
+
+
+// Writes the trimmed reads to out in the same order as the input. Reads with nothing left after trimming are left
+// out.
+bool Trimmer::trim_fastq(std::string filename, std::ostream & out, int threads) {
+    (m_progress ? m_progress->log() : std::cerr) << "Trimming " << filename << "\n";
+    return stream_reads(filename, threads, [this](ReadBatch & batch) {trim_batch(batch);},
+                        [&out](ReadBatch & batch) {out << batch.output;}, m_progress_counters, m_progress);
+}
+
+
+void Trimmer::set_progress(ProgressReporter * progress) {
+    m_progress = progress;
+    m_progress_counters = progress ? progress->add_counters() : NULL;
+}
+
+
+void Trimmer::print_summary() {
+    std::cerr << "  " << int_to_string(m_read_count) << " reads, "
+              << int_to_string(m_start_trim_count) << " trimmed at start, "
+              << int_to_string(m_end_trim_count) << " trimmed at end\n";
+    std::cerr << "  " << int_to_string(m_removed_base_count) << " bases removed, "
+              << int_to_string(m_removed_read_count) << " reads discarded\n\n";
+}
+
+
+void Trimmer::trim_batch(ReadBatch & batch) {
+    long long start_trims = 0, end_trims = 0, removed_reads = 0, removed_bases = 0;
+    for (size_t i = 0; i < batch.count; ++i) {
+        ReadRecord & read = batch.reads[i];
+        int length = int(read.sequence.size());
+        int start_range_end, end_range_start;
+        m_finder.get_windows(length, start_range_end, end_range_start);
+        int trim_start = 0, trim_end = length;
+        if (m_finder.get_start())
+            trim_start = m_finder.find_start_adapter(read.sequence, start_range_end);
+        if (m_finder.get_end())
+            trim_end = std::max(m_finder.find_end_adapter(read.sequence, end_range_start), trim_start);
+        start_trims += (trim_start > 0);
+        end_trims += (trim_end < length);
+        removed_bases += length - (trim_end - trim_start);
+        if (trim_end == trim_start) {
+            ++removed_reads;
+            continue;
+        }
+
+        bool fastq = !read.quality.empty();
+        batch.output += fastq ? '@' : '>';
+        batch.output += read.name;
+        if (!read.comment.empty()) {
+            batch.output += ' ';
+            batch.output += read.comment;
+        }
+        batch.output += '\n';
+        batch.output.append(read.sequence, size_t(trim_start), size_t(trim_end - trim_start));
+        batch.output += '\n';
+        if (fastq) {
+            batch.output += "+\n";
+            batch.output.append(read.quality, size_t(trim_start), size_t(trim_end - trim_start));
+            batch.output += '\n';
+        }
+    }
+    m_read_count += (long long)batch.count;
+    m_start_trim_count += start_trims;
+    m_end_trim_count += end_trims;
+    m_removed_read_count += removed_reads;
+    m_removed_base_count += removed_bases;
+}
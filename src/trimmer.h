@@ -0,0 +1,55 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef TRIMMER_H
+#define TRIMMER_H
+
+
+#include <string>
+#include <ostream>
+#include <atomic>
+
+#include "kmers.h"
+#include "adapter_finder.h"
+#include "read_stream.h"
+
+
+// Trims adapters from reads using the k-mers of a cleaned graph. In each read's start/end window, the cluster of
+// adapter k-mer hits nearest the read end marks the adapter, and the read is cut where that cluster stops.
+class Trimmer
+{
+public:
+    Trimmer(Kmers & kmers);
+
+    bool trim_fastq(std::string filename, std::ostream & out, int threads);
+    void set_progress(ProgressReporter * progress);
+    void print_summary();
+
+private:
+    AdapterFinder m_finder;
+    ProgressReporter * m_progress;
+    ProgressCounters * m_progress_counters;
+
+    std::atomic<long long> m_read_count;
+    std::atomic<long long> m_start_trim_count;
+    std::atomic<long long> m_end_trim_count;
+    std::atomic<long long> m_removed_read_count;
+    std::atomic<long long> m_removed_base_count;
+
+    void trim_batch(ReadBatch & batch);
+};
+
+
+#endif // TRIMMER_H
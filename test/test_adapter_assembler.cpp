@@ -0,0 +1,93 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+
+// Tests for the AdapterAssembler library interface. Reads are made in memory with a known adapter at their starts.
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "adapter_assembler.h"
+
+
+#define ADAPTER "AATGTACTTCGTTCAGTTACGTATTGCT"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+        ++failures; \
+    }
+
+
+static std::vector<std::string> make_reads(int read_count, int read_length) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::vector<std::string> reads;
+    for (int i = 0; i < read_count; ++i) {
+        std::string read = ADAPTER;
+        for (int j = 0; j < read_length; ++j)
+            read += "ACGT"[base(random)];
+        reads.push_back(read);
+    }
+    return reads;
+}
+
+
+static bool has_adapter(const std::vector<AdapterPath> & adapters) {
+    for (auto & adapter : adapters) {
+        if (adapter.sequence.find(ADAPTER) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+
+static void test_adapter_found() {
+    AssemblerOptions options;
+    AdapterAssembler assembler(options);
+    assembler.set_log_callback([](const std::string &) {});
+    assembler.add_reads(make_reads(200, 1000));
+    CHECK(assembler.get_read_count() == 200);
+    CHECK(has_adapter(assembler.get_adapters()));
+}
+
+
+// Reads added from memory must set the margin used by the positional filter, or it removes every k-mer.
+static void test_positional() {
+    AssemblerOptions options;
+    options.positional = true;
+    AdapterAssembler assembler(options);
+    assembler.set_log_callback([](const std::string &) {});
+    assembler.add_reads(make_reads(200, 1000));
+    CHECK(!assembler.get_graph().segments.empty());
+    CHECK(has_adapter(assembler.get_adapters()));
+}
+
+
+int main() {
+    test_adapter_found();
+    test_positional();
+    if (failures > 0) {
+        std::cerr << "test_adapter_assembler: " << failures << " failed\n";
+        return 1;
+    }
+    std::cerr << "test_adapter_assembler: all passed\n";
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Adapter-assembler
+
+// Adapter-assembler is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Adapter-assembler is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Adapter-assembler.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+
+// Tests for AdapterFinder, using a table cleaned from reads with a known adapter at their starts.
+
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "adapter_finder.h"
+
+
+#define ADAPTER "AATGTACTTCGTTCAGTTACGTATTGCT"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+        ++failures; \
+    }
+
+
+static std::mt19937 random_engine(1);
+
+
+static std::string random_bases(int length) {
+    std::uniform_int_distribution<int> base(0, 3);
+    std::string bases;
+    for (int i = 0; i < length; ++i)
+        bases += "ACGT"[base(random_engine)];
+    return bases;
+}
+
+
+static int find_start(const AdapterFinder & finder, const std::string & read) {
+    int start_range_end, end_range_start;
+    finder.get_windows(int(read.size()), start_range_end, end_range_start);
+    return finder.find_start_adapter(read, start_range_end);
+}
+
+
+int main() {
+    Kmers kmers(10);
+    kmers.set_quiet(true);
+    for (int i = 0; i < 200; ++i) {
+        std::string read = ADAPTER + random_bases(1000);
+        kmers.add_read(read.c_str(), int(read.size()), true, false, 250);
+    }
+    kmers.clean(int(kmers.get_max_depth() * 0.05), 10);
+    AdapterFinder finder(kmers);
+    int adapter_length = int(std::string(ADAPTER).size());
+
+    CHECK(find_start(finder, ADAPTER + random_bases(500)) == adapter_length);
+
+    // Reads shorter than k have no k-mers to look at.
+    CHECK(find_start(finder, "AATGTAC") == 0);
+    CHECK(find_start(finder, "") == 0);
+
+    // A sequencing error in the adapter leaves a gap of k hits, which is still one cluster.
+    std::string error_read = ADAPTER + random_bases(500);
+    error_read[14] = (error_read[14] == 'A') ? 'C' : 'A';
+    CHECK(find_start(finder, error_read) == adapter_length);
+
+    // A lone adapter k-mer ahead of the adapter is too small a cluster, so the adapter after it is still found.
+    std::string chance_read = std::string(ADAPTER).substr(0, 10) + random_bases(40) + ADAPTER + random_bases(500);
+    CHECK(find_start(finder, chance_read) == 50 + adapter_length);
+
+    if (failures > 0) {
+        std::cerr << "test_adapter_finder: " << failures << " failed\n";
+        return 1;
+    }
+    std::cerr << "test_adapter_finder: all passed\n";
+    return 0;
+}